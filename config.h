@@ -46,6 +46,7 @@
     "malloc-free.rep", \
     "needle.rep", \
     "nlydf.rep", \
+    "overlap.rep", \
     "perl.rep", \
     "qyqyc.rep", \
     "random.rep", \
@@ -98,14 +99,21 @@
 #define UTIL_WEIGHT .61
 
 /*
- * Alignment requirement in bytes (either 4 or 8)
+ * Alignment requirement in bytes (8, or 16 if built with MMFLAGS=-DALIGN16)
  */
+#ifdef ALIGN16
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8
+#endif
 
 /*
- * Maximum heap size in bytes
+ * Maximum heap size in bytes, per memlib region. Override at build time
+ * for bigger heaps, e.g. make MMFLAGS=-DMAX_HEAP=0x200000000 (8 GiB)
  */
-#define MAX_HEAP (100*(1<<20))  /* 100 MB */
+#ifndef MAX_HEAP
+#define MAX_HEAP ((size_t)100*(1<<20))  /* 100 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
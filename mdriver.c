@@ -9,7 +9,10 @@
  */
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <float.h>
+#include <pthread.h>
+#include <sched.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -18,12 +21,16 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
 #include "config.h"
+#include "tracebin.h"
 
 /**********************
  * Constants and macros
@@ -33,6 +40,17 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define BATCH_ROUNDS  16 /* rounds per timing of the batch benchmark (-B) */
+#define LAT_ROUNDS     4 /* recorded replays per trace of the latency pass (-L) */
+
+/*
+ * Latency histograms are log-linear, as in HdrHistogram: values below
+ * LAT_SUB get a bucket each, then every power of two is split in LAT_SUB
+ * buckets, which bounds the error of a percentile to 1/LAT_SUB.
+ */
+#define LAT_SUB_BITS   5
+#define LAT_SUB        (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS    ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
@@ -54,25 +72,38 @@
  * Remember that index (-1) is the null pointer.
  */
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload. Payloads never overlap,
+ * so the ranges form a treap ordered by lo, with a hash of lo as the
+ * heap priority, and an overlap check only needs the predecessor.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo; free pool link */
+    struct range_t *right; /* ranges above hi */
     int index;             /* same index as free; for debugging */
 } range_t;
 
+/* Treap priority of a range */
+#define RANGE_PRIORITY(p) (((size_t)(p)->lo * 0x9E3779B97F4A7C15UL) >> 32)
+
+/* Range records are carved from pool chunks of this many */
+#define RANGE_CHUNK 4096
+
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, MEMALIGN, CALLOC } type; /* type of request */
     int index;                        /* index for free() to use later */
-    size_t size;                      /* byte size of alloc/realloc request */
+    size_t size;                      /* byte size of alloc/realloc request,
+                                         or of the block to free */
+    size_t align;                     /* payload alignment of alloc request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
 typedef struct {
     char filename[MAXLINE];
-    int ignore_ranges;   /* don't check ranges (i.e. this is too big) */
+    int ignore_ranges;   /* too big to check all block data every op */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
@@ -92,6 +123,46 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/*
+ * Holds the params of one replay thread in thread scaling mode (-T).
+ * Every thread replays the whole trace on its own array of blocks, or
+ * with -X the threads split the ops of one replay by block index: block
+ * i is allocated by thread i % n and reallocated/freed by thread
+ * (i + 1) % n, so that every free is a cross-thread free when n > 1.
+ */
+typedef struct {
+    trace_t *trace;             /* trace to replay, shared and read only */
+    char **blocks;              /* ptrs returned by mm_malloc (shared if -X) */
+    pthread_barrier_t *start;   /* lets all threads start at once */
+    struct timespec t0, t1;     /* when this thread started and finished */
+    int failed;                 /* set if some mm call failed */
+    int id, nthreads;           /* -X: this thread's number, thread count */
+    const int *seq;             /* -X: per op, earlier ops on its block */
+    int *stage;                 /* -X: per block, ops done on it so far */
+} thread_t;
+
+/*
+ * Holds the params of the batch benchmark (-B), timed by fsecs: rounds
+ * of n blocks of size bytes allocated then freed, one call at a time or
+ * with mm_malloc_batch/mm_free_batch.
+ */
+typedef struct {
+    size_t size;                /* payload bytes of every block */
+    int n;                      /* blocks per round */
+    int batch;                  /* set: use the batch calls */
+    void **blocks;              /* the n blocks of the round */
+} batch_t;
+
+/* Ops timed by the latency pass, each with its own histogram */
+enum { LAT_MALLOC, LAT_FREE, LAT_REALLOC, LAT_OPS };
+
+/* Latency histogram of one op type, in TSC cycles */
+typedef struct {
+    uint64_t count[LAT_BUCKETS];
+    uint64_t n;                 /* calls recorded */
+    uint64_t max;               /* slowest call */
+} lathist_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -105,10 +176,23 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    size_t heap_end; /* heap size at the end of the trace, after mm_trim */
+    size_t heap_peak;/* largest heap size during the trace */
+    size_t resident; /* heap bytes backed by memory at the end of the trace */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/*
+ * What a -j worker sends back for one trace. Smaller than PIPE_BUF, so
+ * the workers can share a pipe and each write lands whole.
+ */
+typedef struct {
+    int tracenum;
+    int errors;      /* errors the worker found in the trace */
+    stats_t stats;
+} check_result_t;
+
 /* Summarizes the key statistics for a set of traces */
 typedef struct {
     double util;  /* average utilization expressed as a percentage */
@@ -144,6 +228,42 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* If set, measure thread scaling up to this many threads (-T) */
+static int num_threads = 0;
+
+/* If set, split the ops of the trace across the threads (-X) */
+static int split_threads = 0;
+
+/* Huge pages backing the simulated heap, MEM_HUGE_* (-H) */
+static int huge_pages = MEM_HUGE_NONE;
+
+/* If set, replay frees with mm_free_sized (-S) */
+static int sized_free = 0;
+
+/* If set, run the batch benchmark with this many blocks per call (-B) */
+static int batch_blocks = 0;
+
+/* If not negative, largest block size kept on quick lists (-Q) */
+static int quick_max = -1;
+
+/* If set, compare the placement policies on every trace (-P) */
+static int policy_tests = 0;
+
+/* If set, read the binary foo.bin made by rep2bin for each foo.rep (-b) */
+static int binary_traces = 0;
+
+/* Forked workers for the correctness and util passes (-j) */
+static int num_jobs = 1;
+
+/* If set, print latency percentiles of every trace (-L) ... */
+static int latency_tests = 0;
+
+/* ... and write them to this CSV, or JSON if it ends in .json (-E) */
+static char *latency_file = NULL;
+
+/* Free range records, linked through left */
+static range_t *range_pool = NULL;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -162,11 +282,15 @@ sum_stats_t global_mm_sum_stats;
  * Function prototypes
  *********************/
 
-/* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+/* these functions manipulate the range treap */
+static int add_range(range_t **ranges, char *lo, size_t size, size_t align,
                      const trace_t *trace, int opnum, int index);
+static void insert_range(range_t **link, range_t *p);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *range_alloc(void);
+static void range_free(range_t *p);
+static void check_ranges(const trace_t *trace, int opnum, const range_t *r);
 
 /* These functions implement the debugging code */
 static void init_random_data(void);
@@ -176,6 +300,10 @@ static void randomize_block(trace_t *trace, int index);
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
+static void alloc_trace(trace_t *trace);
+static void read_trace_text(trace_t *trace);
+static int read_trace_bin(trace_t *trace);
+static void check_op(trace_t *trace, int op_index, long index);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
@@ -185,10 +313,44 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
+static void *mm_alloc_op(const traceop_t *op);
+static void mm_free_op(const traceop_t *op, void *p);
+static void *libc_alloc_op(const traceop_t *op);
 static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
 
+/* Routines for measuring the mm package's throughput across threads */
+static void run_thread_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles);
+static double eval_mm_threads(trace_t *trace, int nthreads, const int *seq);
+static void *replay_thread(void *ptr);
+
+/* Routines for the batch allocation benchmark */
+static void run_batch_tests(int n);
+static void check_batch(size_t size, int n, void **blocks);
+static void eval_mm_batch(void *ptr);
+static int batch_cmp(const void *x, const void *y);
+
+/* Placement policy matrix (-P) */
+static void run_policy_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles, range_t *ranges);
+
+/* Per op latency percentiles (-L) */
+static void run_latency_tests(int num_tracefiles, const char *tracedir,
+                              char **tracefiles, range_t *ranges);
+static void eval_mm_latency(trace_t *trace, lathist_t *hist, uint64_t ovhd);
+static inline uint64_t read_tsc(void);
+static inline int lat_index(uint64_t v);
+static uint64_t lat_value(int i);
+static uint64_t lat_percentile(const lathist_t *h, double q);
+
+/* Parallel correctness and util passes (-j) */
+static int check_traces(int num_tracefiles, const char *tracedir,
+                        char **tracefiles, stats_t *mm_stats);
+static void check_trace(int fd, int tracenum, const char *tracedir,
+                        const char *filename) __attribute__((noreturn));
+
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
 static void usage(void);
@@ -215,6 +377,11 @@ static void run_tests(int num_tracefiles, const char *tracedir,
                       stats_t *mm_stats, range_t *ranges, speed_t *speed_params) {
     volatile int i;
     volatile int timed_out = 0;
+    int parallel = num_jobs > 1 && !onetime_flag;
+
+    /* Under -j, workers have done the checks; only the timing is left */
+    if (parallel)
+        timed_out = check_traces(num_tracefiles, tracedir, tracefiles, mm_stats);
 
     for (i=0; i < num_tracefiles; i++) {
         /* initialize simulated memory system in memlib.c *
@@ -232,7 +399,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         mm_stats[i].ops = trace->num_ops;
         if(timed_out) {
             mm_stats[i].valid = 0;
-        } else {
+        } else if (!parallel) {
             if (verbose > 1)
                 printf("Checking mm_malloc for correctness, ");
             mm_stats[i].valid = eval_mm_valid(trace, &ranges);
@@ -243,9 +410,12 @@ static void run_tests(int num_tracefiles, const char *tracedir,
             }
         }
         if (mm_stats[i].valid) {
-            if (verbose > 1)
-                printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
+            if (!parallel) {
+                if (verbose > 1)
+                    printf("efficiency, ");
+                mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i]);
+                printf(".");
+            }
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
@@ -291,7 +461,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:T:H:B:Q:j:E:XhpVAlDSPbL")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -352,6 +522,59 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'T': /* Measure throughput on up to this many threads */
+            num_threads = atoi(optarg);
+            if (num_threads < 1)
+                app_error("-T needs at least one thread\n");
+            break;
+
+        case 'X': /* Split the ops of each trace across the -T threads */
+            split_threads = 1;
+            break;
+
+        case 'H': /* Back the heap with huge pages */
+            huge_pages = atoi(optarg);
+            if (huge_pages < MEM_HUGE_NONE || huge_pages > MEM_HUGE_TLB)
+                app_error("-H takes 0, 1 or 2\n");
+            break;
+
+        case 'B': /* Batch benchmark, this many blocks per call */
+            if ((batch_blocks = atoi(optarg)) <= 0)
+                app_error("-B takes a positive number of blocks\n");
+            break;
+
+        case 'P': /* Util and throughput of every placement policy */
+            policy_tests = 1;
+            break;
+
+        case 'b': /* Binary traces */
+            binary_traces = 1;
+            break;
+
+        case 'L': /* Latency percentiles */
+            latency_tests = 1;
+            break;
+
+        case 'E': /* Export the latency percentiles */
+            latency_tests = 1;
+            latency_file = strdup(optarg);
+            break;
+
+        case 'j': /* Check the traces in this many worker processes */
+            if ((num_jobs = atoi(optarg)) < 1)
+                app_error("-j needs at least one worker\n");
+            break;
+
+        case 'S': /* Free with mm_free_sized */
+            sized_free = 1;
+            break;
+
+        case 'Q': /* Defer coalescing of blocks up to this size */
+            quick_max = atoi(optarg);
+            if (mm_mallopt(MM_QUICK_MAX, quick_max) == 0)
+                app_error("-Q takes a block size from 0 to 1024\n");
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -372,6 +595,23 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+    /* Utilization depends on the alignment, say when it is not the default */
+    if (ALIGNMENT != 8)
+        printf("Payloads aligned to %d bytes\n", ALIGNMENT);
+    if (quick_max >= 0)
+        printf("Quick lists keep freed blocks of up to %d bytes\n", quick_max);
+
+    /* Say which huge pages the heap actually gets */
+    if (huge_pages != MEM_HUGE_NONE) {
+        mem_hugepages(huge_pages);
+        mem_init();
+        printf("Heap backed by %s\n",
+               (mem_hugepages_used() == MEM_HUGE_TLB) ? "reserved huge pages" :
+               (mem_hugepages_used() == MEM_HUGE_THP) ? "transparent huge pages" :
+               "base pages (no huge pages available)");
+        mem_deinit();
+    }
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -448,6 +688,22 @@ int main(int argc, char **argv)
         }
     }
 
+    /* Optionally measure how mm throughput scales with threads */
+    if (num_threads > 0 && !onetime_flag)
+        run_thread_tests(num_tracefiles, tracedir, tracefiles);
+
+    /* Optionally compare batch calls with one call per block */
+    if (batch_blocks > 0 && !onetime_flag)
+        run_batch_tests(batch_blocks);
+
+    /* Optionally compare the placement policies, trace by trace */
+    if (policy_tests && !onetime_flag)
+        run_policy_tests(num_tracefiles, tracedir, tracefiles, ranges);
+
+    /* Optionally report the latency percentiles of each op type */
+    if (latency_tests && !onetime_flag)
+        run_latency_tests(num_tracefiles, tracedir, tracefiles, ranges);
+
     /* Optionally compare the performance of mm and libc */
     if (run_libc) {
         printf("Comparison with libc malloc: mm/libc = %.0f Kops / %.0f Kops = %.2f\n", 
@@ -580,22 +836,24 @@ int main(int argc, char **argv)
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps
+ * The following routines manipulate the range treap, which keeps
  * track of the extent of every allocated block payload. We use the
- * range list to detect any overlapping allocated blocks.
+ * range treap to detect any overlapping allocated blocks.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
- *     we've just called the student's mm_malloc to allocate a block of
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list.
+ *     we've just called the student's mm_malloc (or mm_memalign) to
+ *     allocate a block of size bytes at addr lo, aligned to align bytes.
+ *     After checking the block for correctness, we create a range struct
+ *     for this block and add it to the range treap.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size, size_t align,
                      const trace_t *trace, int opnum, int index)
 {
     char *hi = lo + size - 1;
     range_t *p;
+    range_t *pred = NULL;
 
     assert(size > 0);
 
@@ -606,77 +864,177 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
+    /* And aligned as requested */
+    if ((size_t)lo % align != 0) {
+        malloc_error(trace, opnum,
+                     "Payload address (%p) not aligned to %zu bytes", lo, align);
+        return 0;
+    }
+
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    if (!mem_in_heap(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return 0;
     }
 
-    /* If we can't afford the linear-time loop, we check less thoroughly and
-       just assume the overlap will be caught by writing random bits. */
-    if(trace->ignore_ranges || debug_mode == DBG_NONE) return 1;
-
+    if(debug_mode == DBG_NONE) return 1;
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-            malloc_error(trace, opnum,
-                         "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-                         lo, hi, p->lo, p->hi);
-            return 0;
+    /*
+     * The payload must not overlap any other payloads. Only the range
+     * with the highest lo at or below hi can: find it by going down
+     * towards hi, keeping the last node we turn right at.
+     */
+    for (p = *ranges;  p != NULL; ) {
+        if (p->lo <= hi) {
+            pred = p;
+            p = p->right;
         }
+        else
+            p = p->left;
+    }
+    if (pred != NULL && pred->hi >= lo) {
+        malloc_error(trace, opnum,
+                     "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+                     lo, hi, pred->lo, pred->hi);
+        return 0;
     }
 
     /*
      * Everything looks OK, so remember the extent of this block
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range treap.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-        unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = range_alloc();
     p->lo = lo;
     p->hi = hi;
     p->index = index;
-    *ranges = p;
+    insert_range(ranges, p);
 
     return 1;
 }
 
+/*
+ * insert_range - Hang range p at its leaf under *link, then rotate it
+ *     up while its priority is higher than its parent's
+ */
+static void insert_range(range_t **link, range_t *p)
+{
+    range_t *node = *link;
+
+    if (node == NULL) {
+        p->left = p->right = NULL;
+        *link = p;
+        return;
+    }
+
+    if (p->lo < node->lo) {
+        insert_range(&node->left, p);
+        if (RANGE_PRIORITY(node->left) > RANGE_PRIORITY(node)) {
+            *link = node->left;
+            node->left = (*link)->right;
+            (*link)->right = node;
+        }
+    }
+    else {
+        insert_range(&node->right, p);
+        if (RANGE_PRIORITY(node->right) > RANGE_PRIORITY(node)) {
+            *link = node->right;
+            node->right = (*link)->left;
+            (*link)->left = node;
+        }
+    }
+}
+
 /*
  * remove_range - Free the range record of block whose payload starts at lo
  */
 static void remove_range(range_t **ranges, char *lo)
 {
+    range_t **link = ranges;
     range_t *p;
-    range_t **prevpp = ranges;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-            *prevpp = p->next;
-            free(p);
-            break;
+    range_t *child;
+
+    while (*link != NULL && (*link)->lo != lo)
+        link = lo < (*link)->lo ? &(*link)->left : &(*link)->right;
+    if ((p = *link) == NULL)
+        return;
+
+    /* Rotate the record down, higher priority child up, until it is a leaf */
+    while (p->left != NULL || p->right != NULL) {
+        if (p->right == NULL || (p->left != NULL &&
+                RANGE_PRIORITY(p->left) > RANGE_PRIORITY(p->right))) {
+            child = p->left;
+            p->left = child->right;
+            child->right = p;
+            *link = child;
+            link = &child->right;
+        }
+        else {
+            child = p->right;
+            p->right = child->left;
+            child->left = p;
+            *link = child;
+            link = &child->left;
         }
-        prevpp = &(p->next);
     }
+    *link = NULL;
+    range_free(p);
 }
 
 /*
  * clear_ranges - free all of the range records for a trace
  */
 static void clear_ranges(range_t **ranges)
+{
+    range_t *p = *ranges;
+
+    if (p == NULL)
+        return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    range_free(p);
+    *ranges = NULL;
+}
+
+/*
+ * range_alloc - Take a range record from the pool, which grows a
+ *     chunk at a time and is never handed back to libc
+ */
+static range_t *range_alloc(void)
 {
     range_t *p;
-    range_t *pnext;
+    int i;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+    if (range_pool == NULL) {
+        if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+            unix_error("malloc error in range_alloc");
+        for (i = 0; i < RANGE_CHUNK; i++)
+            range_free(&p[i]);
+    }
+    p = range_pool;
+    range_pool = p->left;
+    return p;
+}
+
+/*
+ * range_free - Return a range record to the pool
+ */
+static void range_free(range_t *p)
+{
+    p->left = range_pool;
+    range_pool = p;
+}
+
+/*
+ * check_ranges - Check the data of every block in the range treap
+ */
+static void check_ranges(const trace_t *trace, int opnum, const range_t *r)
+{
+    for (; r != NULL; r = r->right) {
+        check_ranges(trace, opnum, r->left);
+        check_index(trace, opnum, r->index);
     }
-    *ranges = NULL;
 }
 
 /**********************************************
@@ -751,11 +1109,10 @@ static void check_index(const trace_t *trace, int opnum, int index) {
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename)
 {
-    FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
-    int index, size;
-    int max_index = 0;
+    size_t len;
+    int index;
+    int max_index = -1;
     int op_index;
 
     if (verbose > 1)
@@ -765,23 +1122,51 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         unix_error("malloc 1 failed in read_trace");
 
-    /* Read the trace file header */
+    /* Under -b, foo.rep is read from its binary twin foo.bin */
     strcpy(trace->filename, tracedir);
     strcat(trace->filename, filename);
-    if ((tracefile = fopen(trace->filename, "r")) == NULL) {
-        unix_error("Could not open %s in read_trace", trace->filename);
+    len = strlen(trace->filename);
+    if (binary_traces && len > 4 &&
+        strcmp(trace->filename + len - 4, ".rep") == 0)
+        strcpy(trace->filename + len - 4, ".bin");
+
+    if (!read_trace_bin(trace))
+        read_trace_text(trace);
+
+    /* Frees carry the size of their block, for mm_free_sized */
+    for (op_index = 0; op_index < trace->num_ops; op_index++) {
+        index = trace->ops[op_index].index;
+        if (trace->ops[op_index].type != FREE) {
+            trace->block_sizes[index] = trace->ops[op_index].size;
+            max_index = (index > max_index) ? index : max_index;
+        }
+        else
+            trace->ops[op_index].size = (index < 0) ? 0 : trace->block_sizes[index];
     }
-    fscanf(tracefile, "%d", &trace->weight);
-    fscanf(tracefile, "%d", &trace->num_ids);
-    fscanf(tracefile, "%d", &trace->num_ops);
-    fscanf(tracefile, "%d", &trace->ignore_ranges);
+    memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
+    assert(max_index == trace->num_ids - 1);
 
+    /* fill in the stats */
+    strcpy(stats->filename, trace->filename);
+    stats->weight = trace->weight;
+    stats->ops = trace->num_ops;
+
+    return trace;
+}
+
+/*
+ * alloc_trace - Check the header fields of trace and allocate its arrays
+ */
+static void alloc_trace(trace_t *trace)
+{
     if(trace->weight < 0 || trace->weight > 3) {
         app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
     }
     if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
         app_error("%s: ignore-ranges can only be zero or one", trace->filename);
     }
+    if (trace->num_ids < 0 || trace->num_ops < 0)
+        app_error("%s: bad id or op count", trace->filename);
 
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
@@ -802,49 +1187,166 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     if ((trace->block_rand_base =
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
+}
 
+/*
+ * read_trace_text - Parse the ops of a .rep text trace
+ */
+static void read_trace_text(trace_t *trace)
+{
+    FILE *tracefile;
+    char type[MAXLINE];
+    int index;
+    size_t size = 0, align = 0;
+    int op_index;
+
+    if ((tracefile = fopen(trace->filename, "r")) == NULL) {
+        unix_error("Could not open %s in read_trace", trace->filename);
+    }
+    fscanf(tracefile, "%d", &trace->weight);
+    fscanf(tracefile, "%d", &trace->num_ids);
+    fscanf(tracefile, "%d", &trace->num_ops);
+    fscanf(tracefile, "%d", &trace->ignore_ranges);
+    alloc_trace(trace);
 
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
+    while (op_index < trace->num_ops && fscanf(tracefile, "%s", type) != EOF) {
         switch(type[0]) {
         case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%d %zu", &index, &size);
             trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
+            trace->ops[op_index].align = ALIGNMENT;
+            break;
+        case 'c':
+            fscanf(tracefile, "%d %zu", &index, &size);
+            trace->ops[op_index].type = CALLOC;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = ALIGNMENT;
+            break;
+        case 'm':
+            fscanf(tracefile, "%d %zu %zu", &index, &align, &size);
+            trace->ops[op_index].type = MEMALIGN;
+            trace->ops[op_index].size = size;
+            trace->ops[op_index].align = align;
             break;
         case 'r':
-            fscanf(tracefile, "%u %u", &index, &size);
+            fscanf(tracefile, "%d %zu", &index, &size);
             trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
             trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
+            trace->ops[op_index].align = ALIGNMENT;
             break;
         case 'f':
-            fscanf(tracefile, "%ud", &index);
+            fscanf(tracefile, "%d", &index);
             trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
             break;
         default:
             app_error("Bogus type character (%c) in tracefile %s\n",
                       type[0], trace->filename);
         }
+        check_op(trace, op_index, index);
         op_index++;
-        if(op_index == trace->num_ops) break;
     }
     fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+}
 
-    /* fill in the stats */
-    strcpy(stats->filename, trace->filename);
-    stats->weight = trace->weight;
-    stats->ops = trace->num_ops;
+/*
+ * check_op - Check the block index and alignment of op op_index, and
+ *     store the index
+ */
+static void check_op(trace_t *trace, int op_index, long index)
+{
+    traceop_t *op = &trace->ops[op_index];
+
+    if (index < (op->type == FREE ? -1 : 0) || index >= trace->num_ids)
+        app_error("%s: block index %ld out of range", trace->filename, index);
+    if (op->type == MEMALIGN && (op->align == 0 ||
+                                 (op->align & (op->align - 1)) != 0))
+        app_error("%s: alignment %zu is not a power of two",
+                  trace->filename, op->align);
+    op->index = index;
+}
 
-    return trace;
+/*
+ * read_trace_bin - Map a binary trace (see tracebin.h) and decode its
+ *     op records. Returns 0, having read nothing, if the file does not
+ *     start with the binary magic.
+ */
+static int read_trace_bin(trace_t *trace)
+{
+    const unsigned char *p, *end;
+    tracebin_hdr_t hdr;
+    struct stat st;
+    uint64_t index, align, size;
+    void *map;
+    int fd;
+    int op_index;
+
+    if ((fd = open(trace->filename, O_RDONLY)) < 0)
+        unix_error("Could not open %s in read_trace", trace->filename);
+    if (fstat(fd, &st) < 0)
+        unix_error("Could not stat %s in read_trace", trace->filename);
+    if ((size_t)st.st_size < sizeof(hdr) ||
+        pread(fd, hdr.magic, TRACEBIN_MAGIC_LEN, 0) != TRACEBIN_MAGIC_LEN ||
+        memcmp(hdr.magic, TRACEBIN_MAGIC, TRACEBIN_MAGIC_LEN) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        unix_error("Could not map %s in read_trace", trace->filename);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    memcpy(&hdr, map, sizeof(hdr));
+    if (hdr.op_bytes > st.st_size - sizeof(hdr))
+        app_error("%s: truncated binary trace", trace->filename);
+    trace->weight = hdr.weight;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->ignore_ranges = hdr.ignore_ranges;
+    alloc_trace(trace);
+
+    p = (const unsigned char *)map + sizeof(hdr);
+    end = p + hdr.op_bytes;
+    for (op_index = 0; op_index < trace->num_ops; op_index++) {
+        traceop_t *op = &trace->ops[op_index];
+        int type;
+
+        if (p == end)
+            app_error("%s: truncated binary trace", trace->filename);
+        type = *p++;
+        if ((p = varint_get(p, end, &index)) == NULL)
+            app_error("%s: truncated binary trace", trace->filename);
+        size = 0;
+        align = ALIGNMENT;
+        if (type == 'm')
+            p = varint_get(p, end, &align);
+        if (type != 'f' && p != NULL)
+            p = varint_get(p, end, &size);
+        if (p == NULL)
+            app_error("%s: truncated binary trace", trace->filename);
+
+        switch (type) {
+        case 'a': op->type = ALLOC; break;
+        case 'c': op->type = CALLOC; break;
+        case 'm': op->type = MEMALIGN; break;
+        case 'r': op->type = REALLOC; break;
+        case 'f': op->type = FREE; break;
+        default:
+            app_error("Bogus type character (%c) in tracefile %s\n",
+                      type, trace->filename);
+        }
+        op->size = size;
+        op->align = align;
+        check_op(trace, op_index, (long)index - 1);
+    }
+    munmap(map, st.st_size);
+    return 1;
 }
 
 /*
@@ -875,6 +1377,48 @@ static void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * mm_alloc_op - Serve an allocation request with the mm package,
+ *     through mm_memalign when the trace asked for an alignment and
+ *     mm_calloc for a zeroed block
+ */
+static void *mm_alloc_op(const traceop_t *op)
+{
+    if (op->type == MEMALIGN)
+        return mm_memalign(op->align, op->size);
+    if (op->type == CALLOC)
+        return mm_calloc(1, op->size);
+    return mm_malloc(op->size);
+}
+
+/*
+ * mm_free_op - Free block p of free request op, with mm_free_sized and
+ *     the size of the block under -S
+ */
+static void mm_free_op(const traceop_t *op, void *p)
+{
+    if (sized_free)
+        mm_free_sized(p, op->size);
+    else
+        mm_free(p);
+}
+
+/*
+ * libc_alloc_op - Same, against libc
+ */
+static void *libc_alloc_op(const traceop_t *op)
+{
+    void *p;
+
+    if (op->type == CALLOC)
+        return calloc(1, op->size);
+    if (op->type != MEMALIGN)
+        return malloc(op->size);
+    if (op->align < sizeof(void *))
+        return malloc(op->size);
+    return posix_memalign(&p, op->align, op->size) == 0 ? p : NULL;
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
@@ -882,12 +1426,12 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 {
     int i;
     int index;
-    size_t size;
+    size_t size, j;
     char *newp;
     char *oldp;
     char *p;
 
-    /* Reset the heap and free any records in the range list */
+    /* Reset the heap and free any records in the range treap */
     mem_reset_brk();
     clear_ranges(ranges);
     reinit_trace(trace);
@@ -904,36 +1448,51 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
         size = trace->ops[i].size;
 
         if(debug_mode == DBG_EXPENSIVE) {
-            range_t *r;
-                        
             /* Let the students check their own heap */
             mm_checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
-            r = *ranges;
-            while(r) {
-                check_index(trace, i, r->index);
-                r = r->next;
-            }
+            if (!trace->ignore_ranges)
+                check_ranges(trace, i, *ranges);
         }
 
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
-                malloc_error(trace, i, "mm_malloc failed.");
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL) {
+                malloc_error(trace, i, "mm_%s failed.",
+                             trace->ops[i].type == ALLOC ? "malloc" :
+                             trace->ops[i].type == CALLOC ? "calloc" : "memalign");
                 return 0;
             }
 
+            /* calloc must hand out zeros */
+            if (trace->ops[i].type == CALLOC) {
+                for (j = 0; j < size && p[j] == 0; j++)
+                    ;
+                if (j < size) {
+                    malloc_error(trace, i, "mm_calloc payload byte %zu "
+                                 "(of %zu) not zero", j, size);
+                    return 0;
+                }
+            }
+
             /*
              * Test the range of the new block for correctness and add it
-             * to the range list if OK. The block must be  be aligned properly,
+             * to the range treap if OK. The block must be  be aligned properly,
              * and must not overlap any currently allocated block.
              */
-            if (add_range(ranges, p, size, trace, i, index) == 0)
+            if (add_range(ranges, p, size, trace->ops[i].align, trace, i, index) == 0)
                 return 0;
+            if (mm_malloc_usable_size(p) < size) {
+                malloc_error(trace, i, "mm_malloc_usable_size %zu below "
+                             "request of %zu", mm_malloc_usable_size(p), size);
+                return 0;
+            }
 
             /* Remember region */
             trace->blocks[index] = p;
@@ -960,13 +1519,18 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             }
 
 
-            /* Remove the old region from the range list */
+            /* Remove the old region from the range treap */
             remove_range(ranges, oldp);
 
-            /* Check new block for correctness and add it to range list */
+            /* Check new block for correctness and add it to range treap */
             if (size > 0) {
-                if(add_range(ranges, newp, size, trace, i, index) == 0)
+                if(add_range(ranges, newp, size, ALIGNMENT, trace, i, index) == 0)
+                    return 0;
+                if (mm_malloc_usable_size(newp) < size) {
+                    malloc_error(trace, i, "mm_malloc_usable_size %zu below "
+                                 "request of %zu", mm_malloc_usable_size(newp), size);
                     return 0;
+                }
             }
 
 
@@ -993,7 +1557,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
                 p = trace->blocks[index];
                 remove_range(ranges, p);
             }
-            mm_free(p);
+            mm_free_op(&trace->ops[i], p);
             break;
 
         default:
@@ -1011,20 +1575,22 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   peak size of the heap in bytes while running the student's malloc
+ *   package on the trace. Regions only grow, but mappings (mem_map)
+ *   come and go, so the heap size at the end may be less than its peak.
+ *   The peak, the resident bytes at the end of the trace (mincore) and
+ *   the heap size once mm_trim(0) gave back what it can, are saved in
+ *   stats.
  *
  *   A higher number is better: 1 is optimal.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
     int i;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
@@ -1039,10 +1605,12 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_alloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1082,7 +1650,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 p = trace->blocks[index];
             }
 
-            mm_free(p);
+            mm_free_op(&trace->ops[i], p);
 
             total_size -= size;
             break;
@@ -1097,9 +1665,11 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             total_size : max_total_size;
     }
 
-    printf(".");
-
-    return ((double)max_total_size / (double)mem_heapsize());
+    stats->heap_peak = mem_peaksize();
+    stats->resident = mem_resident();
+    mm_trim(0);
+    stats->heap_end = mem_heapsize();
+    return ((double)max_total_size / (double)stats->heap_peak);
 }
 
 
@@ -1109,7 +1679,8 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index;
+    size_t newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
@@ -1124,9 +1695,10 @@ static void eval_mm_speed(void *ptr)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -1147,7 +1719,7 @@ static void eval_mm_speed(void *ptr)
             } else {
                 block = trace->blocks[index];
             }
-            mm_free(block);
+            mm_free_op(&trace->ops[i], block);
             break;
 
         default:
@@ -1155,6 +1727,724 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * run_thread_tests - For each trace, measure the throughput of the mm
+ *    package with 1, 2, 4, ... up to num_threads threads, each of them
+ *    replaying the whole trace at the same time, and print a table.
+ *    With -X the threads share a single replay instead (see thread_t).
+ */
+static void run_thread_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles)
+{
+    int i, n, op;
+    stats_t stats;
+    trace_t *trace;
+    double secs;
+    int *seq = NULL, *count;
+
+    if (split_threads)
+        printf("Thread scaling (Kops, ops split by block, frees on another thread):\n");
+    else
+        printf("Thread scaling (Kops, every thread replays the whole trace):\n");
+    printf("  %-28s", "trace");
+    for (n = 1; n < num_threads; n *= 2)
+        printf("%10d", n);
+    printf("%10d\n", num_threads);
+
+    for (i = 0; i < num_tracefiles; i++) {
+        mem_init();
+        trace = read_trace(&stats, tracedir, tracefiles[i]);
+        printf("  %-28s", tracefiles[i]);
+
+        /* Number each op among the ops on its block */
+        if (split_threads) {
+            if ((seq = malloc(trace->num_ops * sizeof(int))) == NULL ||
+                (count = calloc(trace->num_ids, sizeof(int))) == NULL)
+                unix_error("malloc failed in run_thread_tests");
+            for (op = 0; op < trace->num_ops; op++) {
+                int index = trace->ops[op].index;
+                seq[op] = (index < 0) ? 0 : count[index]++;
+            }
+            free(count);
+        }
+
+        for (n = 1; ; n = (n * 2 < num_threads) ? n * 2 : num_threads) {
+            secs = eval_mm_threads(trace, n, seq);
+            if (secs <= 0)
+                printf("%10s", "--");
+            else
+                printf("%10.0f", ((seq ? 1 : n) * stats.ops / 1e3) / secs);
+            if (n == num_threads)
+                break;
+        }
+        printf("\n");
+
+        free(seq);
+        seq = NULL;
+        free_trace(trace);
+        mem_deinit();
+    }
+    printf("\n");
+}
+
+/*
+ * eval_mm_threads - Run the trace on nthreads threads at once and return
+ *    the elapsed seconds, best of three runs. Returns -1 if the mm
+ *    package failed (e.g. the heap is too small for nthreads copies).
+ *    If seq is set (-X), the threads split a single replay of the trace,
+ *    seq numbering each op among the ops on its block.
+ */
+static double eval_mm_threads(trace_t *trace, int nthreads, const int *seq)
+{
+    int i, run;
+    double secs, best = -1;
+    thread_t *threads;
+    pthread_t *tids;
+    pthread_barrier_t start;
+    struct timespec *t0, *t1;
+    char **shared = NULL;
+    int *stage = NULL;
+
+    if ((threads = calloc(nthreads, sizeof(thread_t))) == NULL ||
+        (tids = calloc(nthreads, sizeof(pthread_t))) == NULL)
+        unix_error("calloc failed in eval_mm_threads");
+
+    if (seq != NULL &&
+        ((shared = calloc(trace->num_ids, sizeof(char *))) == NULL ||
+         (stage = calloc(trace->num_ids, sizeof(int))) == NULL))
+        unix_error("calloc failed in eval_mm_threads");
+
+    for (i = 0; i < nthreads; i++) {
+        threads[i].trace = trace;
+        threads[i].start = &start;
+        threads[i].id = i;
+        threads[i].nthreads = nthreads;
+        threads[i].seq = seq;
+        threads[i].stage = stage;
+        if (seq != NULL)
+            threads[i].blocks = shared;
+        else if ((threads[i].blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+            unix_error("calloc failed in eval_mm_threads");
+    }
+
+    for (run = 0; run < 3; run++) {
+        /* Reset the heap and initialize the mm package */
+        mem_reset_brk();
+        if (mm_init() < 0)
+            app_error("mm_init failed in eval_mm_threads");
+        if (seq != NULL) {
+            memset(shared, 0, trace->num_ids * sizeof(char *));
+            memset(stage, 0, trace->num_ids * sizeof(int));
+        }
+
+        pthread_barrier_init(&start, NULL, nthreads + 1);
+        for (i = 0; i < nthreads; i++) {
+            threads[i].failed = 0;
+            if (pthread_create(&tids[i], NULL, replay_thread, &threads[i]) != 0)
+                unix_error("pthread_create failed in eval_mm_threads");
+        }
+
+        pthread_barrier_wait(&start);
+        for (i = 0; i < nthreads; i++)
+            pthread_join(tids[i], NULL);
+        pthread_barrier_destroy(&start);
+
+        /* Elapsed time from the first start to the last finish */
+        t0 = &threads[0].t0;
+        t1 = &threads[0].t1;
+        for (i = 0; i < nthreads; i++) {
+            if (threads[i].failed) {
+                best = -1;
+                goto out;
+            }
+            if (threads[i].t0.tv_sec < t0->tv_sec ||
+                (threads[i].t0.tv_sec == t0->tv_sec &&
+                 threads[i].t0.tv_nsec < t0->tv_nsec))
+                t0 = &threads[i].t0;
+            if (threads[i].t1.tv_sec > t1->tv_sec ||
+                (threads[i].t1.tv_sec == t1->tv_sec &&
+                 threads[i].t1.tv_nsec > t1->tv_nsec))
+                t1 = &threads[i].t1;
+        }
+        secs = (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9;
+        if (best < 0 || secs < best)
+            best = secs;
+    }
+
+ out:
+    if (seq != NULL)
+        free(shared);
+    else
+        for (i = 0; i < nthreads; i++)
+            free(threads[i].blocks);
+    free(stage);
+    free(threads);
+    free(tids);
+    return best;
+}
+
+/*
+ * replay_thread - Body of a thread of eval_mm_threads: replay every
+ *    request of the trace on this thread's own blocks. With -X, replay
+ *    only the ops this thread owns, each one after waiting for the
+ *    earlier ops on its block, whatever thread they ran on.
+ */
+static void *replay_thread(void *ptr)
+{
+    thread_t *thread = (thread_t *)ptr;
+    trace_t *trace = thread->trace;
+    char **blocks = thread->blocks;
+    const int *seq = thread->seq;
+    int i, index, owner;
+    size_t size;
+    char *p;
+
+    if (seq == NULL)
+        memset(blocks, 0, trace->num_ids * sizeof(char *));
+    pthread_barrier_wait(thread->start);
+    clock_gettime(CLOCK_MONOTONIC, &thread->t0);
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        if (seq != NULL && index >= 0) {
+            owner = (seq[i] == 0) ? index : index + 1;
+            if (owner % thread->nthreads != thread->id)
+                continue;
+            while (__atomic_load_n(&thread->stage[index], __ATOMIC_ACQUIRE) != seq[i])
+                sched_yield();
+        }
+        else if (seq != NULL && thread->id != 0)
+            continue;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+            if ((p = mm_alloc_op(&trace->ops[i])) == NULL) {
+                thread->failed = 1;
+                if (seq == NULL)
+                    return NULL;
+            }
+            blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            if ((p = mm_realloc(blocks[index], size)) == NULL && size != 0) {
+                thread->failed = 1;
+                if (seq == NULL)
+                    return NULL;
+            }
+            blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            mm_free_op(&trace->ops[i], index < 0 ? NULL : blocks[index]);
+            break;
+
+        default:
+            app_error("Nonexistent request type in replay_thread");
+        }
+
+        /* -X: let the next op on this block go, on whatever thread.
+         * A failed op still counts, so that no thread waits forever. */
+        if (seq != NULL && index >= 0)
+            __atomic_store_n(&thread->stage[index], seq[i] + 1, __ATOMIC_RELEASE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &thread->t1);
+    return NULL;
+}
+
+/*
+ * run_batch_tests - Time rounds of n same sized blocks allocated then
+ *     freed, with one mm_malloc/mm_free per block and with the batch
+ *     calls, for a few sizes from slab slots to large heap blocks
+ */
+static void run_batch_tests(int n)
+{
+    static const size_t sizes[] = { 16, 64, 200, 1000, 4000, 20000 };
+    batch_t params;
+    double secs;
+    unsigned int i;
+
+    if ((params.blocks = malloc(n * sizeof(void *))) == NULL)
+        unix_error("malloc failed in run_batch_tests");
+    printf("Batch allocation (Kops, %d blocks per call, %d rounds):\n",
+           n, BATCH_ROUNDS);
+    printf("  %-10s%10s%10s\n", "size", "loop", "batch");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        mem_init();
+        params.size = sizes[i];
+        params.n = n;
+        check_batch(params.size, n, params.blocks);
+        printf("  %-10zu", params.size);
+        for (params.batch = 0; params.batch <= 1; params.batch++) {
+            secs = fsecs(eval_mm_batch, &params);
+            printf("%10.0f", (2.0 * n * BATCH_ROUNDS / 1e3) / secs);
+        }
+        printf("\n");
+        mem_deinit();
+    }
+    printf("\n");
+    free(params.blocks);
+}
+
+/*
+ * check_batch - Make sure one mm_malloc_batch call gives n aligned
+ *     blocks of size bytes that do not overlap, and that the heap is
+ *     sound after them and after mm_free_batch
+ */
+static void check_batch(size_t size, int n, void **blocks)
+{
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in check_batch");
+    if (mm_malloc_batch(size, n, blocks) != (size_t)n)
+        app_error("mm_malloc_batch of %d %zu-byte blocks failed", n, size);
+
+    /* mm_free_batch sorts blocks by address anyway */
+    qsort(blocks, n, sizeof(void *), batch_cmp);
+    for (i = 0; i < n; i++) {
+        if (!IS_ALIGNED(blocks[i]))
+            app_error("mm_malloc_batch: block %p not aligned to %d bytes",
+                      blocks[i], ALIGNMENT);
+        if (i > 0 && (char *)blocks[i - 1] + size > (char *)blocks[i])
+            app_error("mm_malloc_batch: blocks %p and %p overlap",
+                      blocks[i - 1], blocks[i]);
+        memset(blocks[i], 0xA5, size);
+    }
+    mm_checkheap(0);
+    mm_free_batch(blocks, n);
+    mm_checkheap(0);
+}
+
+/*
+ * batch_cmp - qsort order of blocks, by address
+ */
+static int batch_cmp(const void *x, const void *y)
+{
+    char *p = *(char * const *)x, *q = *(char * const *)y;
+
+    return (p > q) - (p < q);
+}
+
+/*
+ * eval_mm_batch - The function fsecs times for the batch benchmark
+ */
+static void eval_mm_batch(void *ptr)
+{
+    batch_t *params = (batch_t *)ptr;
+    int i, round;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_batch");
+
+    for (round = 0; round < BATCH_ROUNDS; round++) {
+        if (params->batch) {
+            if (mm_malloc_batch(params->size, params->n, params->blocks) !=
+                    (size_t)params->n)
+                app_error("mm_malloc_batch error in eval_mm_batch");
+            mm_free_batch(params->blocks, params->n);
+        }
+        else {
+            for (i = 0; i < params->n; i++)
+                if ((params->blocks[i] = mm_malloc(params->size)) == NULL)
+                    app_error("mm_malloc error in eval_mm_batch");
+            for (i = 0; i < params->n; i++)
+                mm_free(params->blocks[i]);
+        }
+    }
+}
+
+/*
+ * run_latency_tests - Replay each valid trace LAT_ROUNDS times, timing
+ *     every call with rdtscp, and print p50/p99/p99.9 of each op type.
+ *     The overhead of a back to back rdtscp pair is subtracted. Runs
+ *     after, and apart from, the throughput timing of eval_mm_speed.
+ */
+static void run_latency_tests(int num_tracefiles, const char *tracedir,
+                              char **tracefiles, range_t *ranges)
+{
+    static const char *names[] = { "malloc", "free", "realloc" };
+    static const double qs[] = { 0.5, 0.99, 0.999 };
+    lathist_t *hist;
+    stats_t stats;
+    trace_t *trace;
+    FILE *out = NULL;
+    uint64_t ovhd = UINT64_MAX;
+    uint64_t t;
+    int json = 0;
+    int first = 1;
+    int i, k, r;
+    size_t len;
+
+    if ((hist = (lathist_t *)malloc(LAT_OPS * sizeof(lathist_t))) == NULL)
+        unix_error("malloc failed in run_latency_tests");
+
+    for (i = 0; i < 1000; i++) {
+        t = read_tsc();
+        t = read_tsc() - t;
+        ovhd = t < ovhd ? t : ovhd;
+    }
+
+    if (latency_file != NULL) {
+        if ((out = fopen(latency_file, "w")) == NULL)
+            unix_error("Could not open %s in run_latency_tests", latency_file);
+        len = strlen(latency_file);
+        json = len > 5 && strcmp(latency_file + len - 5, ".json") == 0;
+        fprintf(out, json ? "[\n" : "trace,op,count,p50,p99,p99.9,max\n");
+    }
+
+    printf("Latency (TSC cycles per call, %d replays, %llu cycles of rdtscp "
+           "taken off):\n", LAT_ROUNDS, (unsigned long long)ovhd);
+    printf("  %-28s", "");
+    for (k = 0; k < LAT_OPS; k++)
+        printf("%21s", names[k]);
+    printf("\n  %-28s", "trace");
+    for (k = 0; k < LAT_OPS; k++)
+        printf("%7s%7s%7s", "p50", "p99", "p99.9");
+    printf("\n");
+
+    for (i = 0; i < num_tracefiles; i++) {
+        mem_init();
+        trace = read_trace(&stats, tracedir, tracefiles[i]);
+        printf("  %-28s", tracefiles[i]);
+        if (!eval_mm_valid(trace, &ranges)) {
+            printf("%21s\n", "--");
+            free_trace(trace);
+            mem_deinit();
+            continue;
+        }
+
+        memset(hist, 0, LAT_OPS * sizeof(lathist_t));
+        eval_mm_latency(trace, hist, ovhd);     /* Warm up, then reset */
+        memset(hist, 0, LAT_OPS * sizeof(lathist_t));
+        for (r = 0; r < LAT_ROUNDS; r++)
+            eval_mm_latency(trace, hist, ovhd);
+
+        for (k = 0; k < LAT_OPS; k++) {
+            if (hist[k].n == 0) {
+                printf("%7s%7s%7s", "-", "-", "-");
+                continue;
+            }
+            for (r = 0; r < 3; r++)
+                printf("%7llu",
+                       (unsigned long long)lat_percentile(&hist[k], qs[r]));
+            if (out == NULL)
+                continue;
+            if (json)
+                fprintf(out, "%s  {\"trace\": \"%s\", \"op\": \"%s\", "
+                        "\"count\": %llu, \"p50\": %llu, \"p99\": %llu, "
+                        "\"p99.9\": %llu, \"max\": %llu}",
+                        first ? "" : ",\n", tracefiles[i], names[k],
+                        (unsigned long long)hist[k].n,
+                        (unsigned long long)lat_percentile(&hist[k], qs[0]),
+                        (unsigned long long)lat_percentile(&hist[k], qs[1]),
+                        (unsigned long long)lat_percentile(&hist[k], qs[2]),
+                        (unsigned long long)hist[k].max);
+            else
+                fprintf(out, "%s,%s,%llu,%llu,%llu,%llu,%llu\n",
+                        tracefiles[i], names[k],
+                        (unsigned long long)hist[k].n,
+                        (unsigned long long)lat_percentile(&hist[k], qs[0]),
+                        (unsigned long long)lat_percentile(&hist[k], qs[1]),
+                        (unsigned long long)lat_percentile(&hist[k], qs[2]),
+                        (unsigned long long)hist[k].max);
+            first = 0;
+        }
+        printf("\n");
+        free_trace(trace);
+        mem_deinit();
+    }
+    printf("\n");
+
+    if (out != NULL) {
+        if (json)
+            fprintf(out, "\n]\n");
+        if (fclose(out) != 0)
+            unix_error("Could not write %s in run_latency_tests", latency_file);
+    }
+    free(hist);
+}
+
+/*
+ * eval_mm_latency - Replay the trace as eval_mm_speed does, adding the
+ *     cycles of every mm call to the histogram of its op type
+ */
+static void eval_mm_latency(trace_t *trace, lathist_t *hist, uint64_t ovhd)
+{
+    int i, index, k;
+    char *p, *block;
+    uint64_t t;
+    lathist_t *h;
+
+    reinit_trace(trace);
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+        case MEMALIGN: /* mm_memalign */
+        case CALLOC: /* mm_calloc */
+            k = LAT_MALLOC;
+            t = read_tsc();
+            p = mm_alloc_op(&trace->ops[i]);
+            t = read_tsc() - t;
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            k = LAT_REALLOC;
+            t = read_tsc();
+            p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            t = read_tsc() - t;
+            if (p == NULL && trace->ops[i].size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            k = LAT_FREE;
+            block = index < 0 ? NULL : trace->blocks[index];
+            t = read_tsc();
+            mm_free_op(&trace->ops[i], block);
+            t = read_tsc() - t;
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+
+        t = t > ovhd ? t - ovhd : 0;
+        h = &hist[k];
+        h->count[lat_index(t)]++;
+        h->n++;
+        h->max = t > h->max ? t : h->max;
+    }
+}
+
+/*
+ * read_tsc - Read the time stamp counter. rdtscp waits for the
+ *     instructions before it, so the timed call is not cut short.
+ */
+static inline uint64_t read_tsc(void)
+{
+    uint32_t lo, hi;
+
+    __asm__ __volatile__("rdtscp" : "=a"(lo), "=d"(hi) : : "rcx", "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * lat_index - Histogram bucket of v: exact below LAT_SUB, else the top
+ *     LAT_SUB_BITS bits under the leading one pick a slice of its octave
+ */
+static inline int lat_index(uint64_t v)
+{
+    int msb;
+
+    if (v < LAT_SUB)
+        return v;
+    msb = 63 - __builtin_clzll(v);
+    return ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+        (int)((v >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/*
+ * lat_value - Smallest value that lands in bucket i
+ */
+static uint64_t lat_value(int i)
+{
+    if (i < LAT_SUB)
+        return i;
+    return (uint64_t)(LAT_SUB + (i & (LAT_SUB - 1))) <<
+        ((i >> LAT_SUB_BITS) - 1);
+}
+
+/*
+ * lat_percentile - Value at or below which a fraction q of the calls
+ *     fall: the top of the bucket that holds it, capped at the maximum
+ */
+static uint64_t lat_percentile(const lathist_t *h, double q)
+{
+    uint64_t want = (uint64_t)(q * h->n + 0.999999);
+    uint64_t seen = 0;
+    uint64_t top;
+    int i;
+
+    if (want == 0)
+        want = 1;
+    for (i = 0; i < LAT_BUCKETS - 1; i++) {
+        seen += h->count[i];
+        if (seen >= want)
+            break;
+    }
+    top = (i < LAT_BUCKETS - 1) ? lat_value(i + 1) - 1 : h->max;
+    return top < h->max ? top : h->max;
+}
+
+/*
+ * check_traces - Run the correctness and util passes of the traces in
+ *     up to num_jobs forked workers, each with its own memlib heap, and
+ *     gather their stats into mm_stats. Returns 1 on a timeout, which
+ *     kills the workers and leaves their traces invalid.
+ */
+static int check_traces(int num_tracefiles, const char *tracedir,
+                        char **tracefiles, stats_t *mm_stats)
+{
+    check_result_t res;
+    pid_t *pids;
+    pid_t pid;
+    int fds[2];
+    volatile int next = 0;
+    volatile int running = 0;
+    int i, status;
+
+    if ((pids = (pid_t *)calloc(num_tracefiles, sizeof(pid_t))) == NULL)
+        unix_error("calloc failed in check_traces");
+    if (pipe(fds) < 0)
+        unix_error("pipe failed in check_traces");
+
+    if (setjmp(timeout_jmpbuf) != 0) {
+        for (i = 0; i < num_tracefiles; i++)
+            if (pids[i] > 0)
+                kill(pids[i], SIGKILL);
+        while (wait(NULL) > 0)
+            ;
+        close(fds[0]);
+        close(fds[1]);
+        free(pids);
+        return 1;
+    }
+
+    while (next < num_tracefiles || running > 0) {
+        /* Keep num_jobs workers busy */
+        if (next < num_tracefiles && running < num_jobs) {
+            if ((pid = fork()) < 0)
+                unix_error("fork failed in check_traces");
+            if (pid == 0) {
+                close(fds[0]);
+                check_trace(fds[1], next, tracedir, tracefiles[next]);
+            }
+            pids[next] = pid;
+            next = next + 1;
+            running = running + 1;
+            continue;
+        }
+
+        /* A worker that exits cleanly has written its result */
+        if ((pid = wait(&status)) < 0)
+            unix_error("wait failed in check_traces");
+        running = running - 1;
+        for (i = 0; pids[i] != pid; i++)
+            ;
+        pids[i] = 0;
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            if (read(fds[0], &res, sizeof(res)) != sizeof(res))
+                unix_error("read failed in check_traces");
+            mm_stats[res.tracenum] = res.stats;
+            errors += res.errors;
+        }
+        else {
+            printf("ERROR [trace %s]: worker died\n", tracefiles[i]);
+            errors++;
+        }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    free(pids);
+    return 0;
+}
+
+/*
+ * check_trace - Body of a -j worker: check one trace, measure its util,
+ *     and write the result to fd
+ */
+static void check_trace(int fd, int tracenum, const char *tracedir,
+                        const char *filename)
+{
+    check_result_t res;
+    range_t *ranges = NULL;
+    trace_t *trace;
+
+    memset(&res, 0, sizeof(res));
+    errors = 0;
+    mem_init();
+    trace = read_trace(&res.stats, tracedir, filename);
+    res.tracenum = tracenum;
+    res.stats.valid = eval_mm_valid(trace, &ranges);
+    if (res.stats.valid) {
+        res.stats.util = eval_mm_util(trace, tracenum, &res.stats);
+        printf(".");
+    }
+    res.errors = errors;
+    if (write(fd, &res, sizeof(res)) != sizeof(res))
+        _exit(1);
+    _exit(0);
+}
+
+/*
+ * run_policy_tests - Replay each trace under every placement policy
+ *    (mm_mallopt(MM_PLACEMENT)) and print a row of util and Kops per
+ *    trace. Policies the mm package refuses, and runs that fail the
+ *    correctness check, show as --. Leaves the last policy set.
+ */
+static void run_policy_tests(int num_tracefiles, const char *tracedir,
+                             char **tracefiles, range_t *ranges)
+{
+    static const char *names[] = { "lifo", "address", "next fit" };
+    stats_t stats;
+    speed_t params;
+    trace_t *trace;
+    double util, secs;
+    int i, p;
+
+    printf("Placement policies (util, Kops):\n");
+    printf("  %-28s", "trace");
+    for (p = MM_PLACE_LIFO; p <= MM_PLACE_NEXT_FIT; p++)
+        printf("%18s", names[p]);
+    printf("\n");
+
+    for (i = 0; i < num_tracefiles; i++) {
+        printf("  %-28s", tracefiles[i]);
+        for (p = MM_PLACE_LIFO; p <= MM_PLACE_NEXT_FIT; p++) {
+            fflush(stdout);
+            if (!mm_mallopt(MM_PLACEMENT, p)) {
+                printf("%18s", "--");
+                continue;
+            }
+            mem_init();
+            trace = read_trace(&stats, tracedir, tracefiles[i]);
+            if (eval_mm_valid(trace, &ranges)) {
+                util = eval_mm_util(trace, i, &stats);
+                params.trace = trace;
+                params.ranges = ranges;
+                secs = fsecs(eval_mm_speed, &params);
+                printf("%7.0f%%%10.0f", util * 100.0, (trace->num_ops / 1e3) / secs);
+            }
+            else
+                printf("%18s", "--");
+            free_trace(trace);
+            mem_deinit();
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1163,7 +2453,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace)
 {
-    int i, newsize;
+    int i;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     reinit_trace(trace);
@@ -1172,7 +2463,9 @@ static int eval_libc_valid(trace_t *trace)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
+        case MEMALIGN: /* posix_memalign */
+        case CALLOC: /* calloc */
+            if ((p = libc_alloc_op(&trace->ops[i])) == NULL) {
                 malloc_error(trace, i, "libc malloc failed");
                 unix_error("System message");
             }
@@ -1213,7 +2506,8 @@ static int eval_libc_valid(trace_t *trace)
 static void eval_libc_speed(void *ptr)
 {
     int i;
-    int index, size, newsize;
+    int index;
+    size_t newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -1222,9 +2516,10 @@ static void eval_libc_speed(void *ptr)
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
         case ALLOC: /* malloc */
+        case MEMALIGN: /* posix_memalign */
+        case CALLOC: /* calloc */
             index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = malloc(size)) == NULL)
+            if ((p = libc_alloc_op(&trace->ops[i])) == NULL)
                 unix_error("malloc failed in eval_libc_speed");
             trace->blocks[index] = p;
             break;
@@ -1275,8 +2570,9 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     char wstr;
 
     /* Print the individual results for each trace */
-    printf("  %2s%6s %5s%8s%9s  %s\n",
-           "valid", "util", "ops", "secs", "Kops", "trace");
+    printf("  %2s%6s %5s%8s%9s%8s%8s%8s  %s\n",
+           "valid", "util", "ops", "secs", "Kops", "heapK", "peakK", "rssK",
+           "trace");
     for (i=0; i < n; i++) {
         if (stats[i].valid) {
             switch(stats[i].weight)
@@ -1318,6 +2614,13 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
             else
                 printf("%8s%10s%6s", "--", "--", "--");
 
+            /* print '--' where the heap size is not known (libc) */
+            if (stats[i].heap_peak > 0)
+                printf("%8.0f%8.0f%8.0f", stats[i].heap_end / 1024.0,
+                       stats[i].heap_peak / 1024.0, stats[i].resident / 1024.0);
+            else
+                printf("%8s%8s%8s", "--", "--", "--");
+
             printf(" %s\n", stats[i].filename);
 
             if(stats[i].weight == WALL || stats[i].weight == WPERF)
@@ -1428,7 +2731,7 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDS] [-f <file>] [-T <n> [-X]] [-H <m>] [-B <n>] [-Q <b>] [-P] [-b] [-j <n>] [-L] [-E <file>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-p         Calculate Checkpoint Score.\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
@@ -1441,4 +2744,15 @@ static void usage(void)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-T <n>     Measure throughput on 1, 2, 4, ... n threads.\n");
+    fprintf(stderr, "\t-X         With -T, split ops across threads by block (cross-thread frees).\n");
+    fprintf(stderr, "\t-H <m>     Heap on 2 MiB pages: 0 none; 1 transparent; 2 reserved, else 1.\n");
+    fprintf(stderr, "\t-S         Free blocks with mm_free_sized.\n");
+    fprintf(stderr, "\t-B <n>     Batch benchmark: n blocks per mm_malloc_batch call.\n");
+    fprintf(stderr, "\t-P         Util and Kops of each trace under every placement policy.\n");
+    fprintf(stderr, "\t-j <n>     Check correctness and util in n worker processes; time serially.\n");
+    fprintf(stderr, "\t-L         Latency percentiles of malloc, free and realloc (TSC cycles).\n");
+    fprintf(stderr, "\t-E <file>  -L, and write them to <file>: JSON if it ends in .json, else CSV.\n");
+    fprintf(stderr, "\t-b         Read the binary .bin twin of each .rep trace (make bintraces).\n");
+    fprintf(stderr, "\t-Q <b>     Coalesce freed blocks of up to b bytes in bulk (default 256, 0: at once).\n");
 }
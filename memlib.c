@@ -2,7 +2,28 @@
  * memlib.c - a module that simulates the memory system.	Needed because it 
  *						allows us to interleave calls from the student's malloc package 
  *						with the system's malloc package in libc.
+ *
+ * The memory is split in MEM_REGIONS disjoint regions of MAX_HEAP bytes,
+ * each with its own brk pointer, so a malloc package can grow several
+ * independent heaps (e.g. one per arena). Region 0 is the classic heap
+ * used by mem_sbrk.
+ *
+ * Besides the regions, mem_map hands out mappings of their own (e.g. for
+ * huge blocks). They count in the heap size while they are mapped, and
+ * mem_peaksize remembers the largest heap size ever reached, since the
+ * heap can now shrink.
+ *
+ * Pages of the heap can be decommitted (mem_decommit) while the heap
+ * keeps its size, and mem_resident tells how many bytes are backed by
+ * memory right now. mem_region_zero tells where the never touched (or
+ * given back) top of a region starts: memory the heap grows into from
+ * there reads as zero.
+ *
+ * mem_hugepages asks for the regions to be backed by 2 MiB pages from the
+ * next mem_init on: transparent huge pages (MADV_HUGEPAGE), or reserved
+ * ones (MAP_HUGETLB) falling back to transparent ones if none are left.
  */
+#define _GNU_SOURCE						/* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,66 +31,302 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
-#include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include "memlib.h"
 #include "config.h"
 
 /* private variables */
-static char *heap;
-static char *mem_brk;
-static char *mem_max_addr;
+static char *heap;						/* start of region 0 */
+static char *mem_brk[MEM_REGIONS];		/* brk pointer of each region */
+static char *mem_zero[MEM_REGIONS];		/* all zero from here up, per region */
+static size_t mem_size;					/* bytes in regions and mappings */
+static size_t mem_peak;					/* largest mem_size so far */
+static int mem_huge_mode;				/* huge pages asked for, MEM_HUGE_* */
+static int mem_huge;					/* huge pages the regions got */
+
+/* Live mappings, unordered. Any thread may map, so they take map_lock */
+typedef struct {
+	char *lo;							/* first byte of the mapping */
+	size_t size;						/* bytes mapped */
+} mapping_t;
+static mapping_t *maps;
+static int num_maps, max_maps;
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Start of region r */
+#define REGION_LO(r) (heap + (size_t)(r) * MAX_HEAP)
+
+/*
+ * mem_grow - count incr more (or less) bytes in the heap size, and keep
+ *		the peak. Lock free, regions grow concurrently.
+ */
+static void mem_grow(long incr) {
+	size_t size = __atomic_add_fetch(&mem_size, incr, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&mem_peak, __ATOMIC_RELAXED);
+	while (size > peak && !__atomic_compare_exchange_n(&mem_peak, &peak,
+				size, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * mem_unmap_all - drop every mapping, e.g. when resetting the heap
+ */
+static void mem_unmap_all(void) {
+	pthread_mutex_lock(&map_lock);
+	while (num_maps > 0) {
+		num_maps--;
+		munmap(maps[num_maps].lo, maps[num_maps].size);
+	}
+	pthread_mutex_unlock(&map_lock);
+}
 
 /* 
  * mem_init - initialize the memory system model
+ *		All regions are reserved at once, one after the other, so
+ *		mem_region_of is just arithmetic. Pages only get memory when
+ *		they are touched.
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
-	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
-			PROT_WRITE,				/* permissions */
-			MAP_PRIVATE,			/* private or shared? */
-			dev_zero,				/* fd */
-			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
-	mem_brk = heap;					/* heap is empty initially */
+	int r;
+
+	/* Reserved huge pages: the whole heap must fit in the pool */
+	mem_huge = MEM_HUGE_NONE;
+	heap = MAP_FAILED;
+	if (mem_huge_mode == MEM_HUGE_TLB) {
+		heap = mmap((void *)0x800000000, (size_t)MEM_REGIONS * MAX_HEAP,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+				(21 << MAP_HUGE_SHIFT),	/* log2(HUGE_PAGESIZE) */
+				-1, 0);
+		if (heap != MAP_FAILED)
+			mem_huge = MEM_HUGE_TLB;
+	}
+
+	/* Private anonymous memory: MADV_FREE only works on such pages */
+	if (heap == MAP_FAILED)
+		heap = mmap((void *)0x800000000, /* suggested start*/
+				(size_t)MEM_REGIONS * MAX_HEAP,	/* length */
+				PROT_READ | PROT_WRITE,	/* permissions */
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, /* private or shared? */
+				-1,						/* fd */
+				0);						/* offset (dunno) */
+	if (mem_huge_mode != MEM_HUGE_NONE && mem_huge == MEM_HUGE_NONE &&
+			madvise(heap, (size_t)MEM_REGIONS * MAX_HEAP, MADV_HUGEPAGE) == 0)
+		mem_huge = MEM_HUGE_THP;
+	for (r = 0; r < MEM_REGIONS; r++)
+		mem_brk[r] = mem_zero[r] = REGION_LO(r); /* heaps are empty initially */
+	mem_size = mem_peak = 0;
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	mem_unmap_all();
+	munmap(heap, (size_t)MEM_REGIONS * MAX_HEAP);
+}
+
+/*
+ * mem_hugepages - back the regions with huge pages (mode MEM_HUGE_THP or
+ *		MEM_HUGE_TLB) or not (MEM_HUGE_NONE), from the next mem_init on
+ */
+void mem_hugepages(int mode){
+	mem_huge_mode = mode;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers to make empty heaps,
+ *		and drop all mappings
  */
 void mem_reset_brk(){
-	mem_brk = heap;
+	int r;
+	for (r = 0; r < MEM_REGIONS; r++)
+		mem_brk[r] = REGION_LO(r);
+	mem_unmap_all();
+	mem_size = mem_peak = 0;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *		by incr bytes and returns the start address of the new area. In
- *		this model, the heap cannot be shrunk.
+ *		by incr bytes and returns the start address of the new area. A
+ *		negative incr shrinks the heap, giving back its top.
  */
-void *mem_sbrk(int incr) {
-	char *old_brk = mem_brk;
+void *mem_sbrk(intptr_t incr) {
+	return mem_region_sbrk(0, incr);
+}
+
+/* 
+ * mem_region_sbrk - mem_sbrk for the heap of region r. Regions never
+ *		overlap, so each one grows (or shrinks) contiguously on its own.
+ */
+void *mem_region_sbrk(int r, intptr_t incr) {
+	char *old_brk = mem_brk[r];
+
+	/* Shrinking: whole pages above the new brk go back to the OS */
+	if (incr < 0) {
+		size_t page = mem_pagesize();
+		char *lo, *hi;
+
+		if (old_brk + incr < REGION_LO(r)) {
+			errno = EINVAL;
+			return (void *)-1;
+		}
+		lo = (char *)(((size_t)(old_brk + incr) + page - 1) & ~(page - 1));
+		hi = (char *)(((size_t)old_brk + page - 1) & ~(page - 1));
+		if (hi > lo)
+			madvise(lo, hi - lo, MADV_DONTNEED);
+		if (lo < mem_zero[r])
+			mem_zero[r] = lo;
+		mem_brk[r] += incr;
+		mem_grow(incr);
+		return (void *)old_brk;
+	}
 
-    // call sbrk() in an attempt to have similar semantics as a real allocator.
-	if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ||
-            sbrk(incr) == (void *) -1) {
+	/* No real sbrk: the region is already reserved, and a brk grown here
+	 * but never shrunk would climb with every trim and regrow */
+	if ((old_brk + incr) > REGION_LO(r + 1)) {
 		errno = ENOMEM;
 		fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 		return (void *)-1;
 	}
 
-	mem_brk += incr;
+	mem_brk[r] += incr;
+	if (mem_brk[r] > mem_zero[r])
+		mem_zero[r] = mem_brk[r];
+	mem_grow(incr);
 	return (void *)old_brk;
 }
 
+/*
+ * mem_map - map size bytes (a multiple of the page size) of zeroed
+ *		memory outside the regions. Returns NULL on failure.
+ */
+void *mem_map(size_t size) {
+	char *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	mapping_t *m;
+
+	if (p == MAP_FAILED)
+		return NULL;
+
+	pthread_mutex_lock(&map_lock);
+	if (num_maps == max_maps) {
+		max_maps = max_maps ? 2 * max_maps : 64;
+		if ((m = realloc(maps, max_maps * sizeof(mapping_t))) == NULL) {
+			pthread_mutex_unlock(&map_lock);
+			munmap(p, size);
+			return NULL;
+		}
+		maps = m;
+	}
+	maps[num_maps].lo = p;
+	maps[num_maps].size = size;
+	num_maps++;
+	pthread_mutex_unlock(&map_lock);
+
+	mem_grow(size);
+	return p;
+}
+
+/*
+ * mem_remap - resize the mapping at p from oldsize to newsize bytes,
+ *		moving it if needed (the pages move, the data is not copied).
+ *		Returns its new address, NULL on failure.
+ */
+void *mem_remap(void *p, size_t oldsize, size_t newsize) {
+	char *q;
+	int i;
+
+	pthread_mutex_lock(&map_lock);
+	for (i = 0; i < num_maps && maps[i].lo != p; i++)
+		;
+	assert(i < num_maps && maps[i].size == oldsize);
+	if ((q = mremap(p, oldsize, newsize, MREMAP_MAYMOVE)) == MAP_FAILED) {
+		pthread_mutex_unlock(&map_lock);
+		return NULL;
+	}
+	maps[i].lo = q;
+	maps[i].size = newsize;
+	pthread_mutex_unlock(&map_lock);
+
+	mem_grow((long)newsize - (long)oldsize);
+	return q;
+}
+
+/*
+ * mem_unmap - give back the mapping of size bytes at p
+ */
+void mem_unmap(void *p, size_t size) {
+	int i;
+
+	pthread_mutex_lock(&map_lock);
+	for (i = 0; i < num_maps && maps[i].lo != p; i++)
+		;
+	assert(i < num_maps && maps[i].size == size);
+	maps[i] = maps[--num_maps];
+	munmap(p, size);
+	pthread_mutex_unlock(&map_lock);
+
+	mem_grow(-(long)size);
+}
+
+/*
+ * mem_decommit - give the pages of size bytes at p (both page aligned)
+ *		back to the OS. They stay in the heap and read as zero when
+ *		touched again. With lazy set, the OS only takes them back if it
+ *		runs short of memory (MADV_FREE), and they keep their data until
+ *		then; this falls back to MADV_DONTNEED where MADV_FREE is missing.
+ */
+void mem_decommit(void *p, size_t size, int lazy) {
+#ifdef MADV_FREE
+	if (lazy && madvise(p, size, MADV_FREE) == 0)
+		return;
+#endif
+	madvise(p, size, MADV_DONTNEED);
+}
+
+/*
+ * mem_resident_range - count the bytes from lo up to hi (page aligned) that
+ *		are backed by memory, with mincore
+ */
+static size_t mem_resident_range(char *lo, char *hi) {
+	static unsigned char vec[4096];
+	size_t page = mem_pagesize();
+	size_t i, n, resident = 0;
+
+	while (lo < hi) {
+		n = ((size_t)(hi - lo) / page < sizeof(vec)) ?
+			(size_t)(hi - lo) / page : sizeof(vec);
+		if (mincore(lo, n * page, vec) == 0)
+			for (i = 0; i < n; i++)
+				resident += (vec[i] & 1) * page;
+		lo += n * page;
+	}
+	return resident;
+}
+
+/*
+ * mem_resident - returns the bytes of the regions and mappings that are
+ *		backed by memory right now. Not thread safe against mem_sbrk.
+ */
+size_t mem_resident(void) {
+	size_t page = mem_pagesize();
+	size_t resident = 0;
+	int r, i;
+
+	for (r = 0; r < MEM_REGIONS; r++)
+		resident += mem_resident_range(REGION_LO(r),
+				(char *)(((size_t)mem_brk[r] + page - 1) & ~(page - 1)));
+
+	pthread_mutex_lock(&map_lock);
+	for (i = 0; i < num_maps; i++)
+		resident += mem_resident_range(maps[i].lo, maps[i].lo + maps[i].size);
+	pthread_mutex_unlock(&map_lock);
+	return resident;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -78,17 +335,98 @@ void *mem_heap_lo(){
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_heap_hi - return address of last heap byte, in the highest region
+ *		that is not empty
  */
 void *mem_heap_hi(){
-	return (void *)(mem_brk - 1);
+	int r = MEM_REGIONS - 1;
+	while (r > 0 && mem_brk[r] == REGION_LO(r))
+		r--;
+	return (void *)(mem_brk[r] - 1);
+}
+
+/*
+ * mem_region_lo - return address of the first byte of region r
+ */
+void *mem_region_lo(int r){
+	return (void *)REGION_LO(r);
+}
+
+/*
+ * mem_region_hi - return address of the last byte of the heap of region r
+ */
+void *mem_region_hi(int r){
+	return (void *)(mem_brk[r] - 1);
+}
+
+/*
+ * mem_region_zero - return the lowest address of region r from which
+ *		memory was never written since mapped or given back: what the
+ *		heap grows into past it reads as zero. mem_reset_brk keeps it.
+ */
+void *mem_region_zero(int r){
+	return (void *)mem_zero[r];
+}
+
+/*
+ * mem_region_of - return the region holding address p, -1 if none
+ */
+int mem_region_of(const void *p){
+	if ((char *)p < heap || (char *)p >= REGION_LO(MEM_REGIONS))
+		return -1;
+	return ((char *)p - heap) / MAX_HEAP;
+}
+
+/*
+ * mem_in_heap - return whether bytes lo to hi are all in the heap, that
+ *		is in one region and below its brk, or in one mapping
+ */
+int mem_in_heap(const void *lo, const void *hi){
+	int r = mem_region_of(lo);
+	int i, found = 0;
+
+	if ((char *)hi < (char *)lo)
+		return 0;
+	if (r >= 0)
+		return (char *)hi < mem_brk[r] && mem_region_of(hi) == r;
+
+	pthread_mutex_lock(&map_lock);
+	for (i = 0; i < num_maps && !found; i++)
+		found = (char *)lo >= maps[i].lo &&
+			(char *)hi < maps[i].lo + maps[i].size;
+	pthread_mutex_unlock(&map_lock);
+	return found;
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_heapsize() - returns the heap size in bytes, over all regions and
+ *		mappings
  */
 size_t mem_heapsize() {
-	return (size_t)((void *)mem_brk - (void *)heap);
+	return mem_size;
+}
+
+/*
+ * mem_peaksize() - returns the largest heap size since the last reset
+ */
+size_t mem_peaksize() {
+	return mem_peak;
+}
+
+/*
+ * mem_hugepagesize() - returns the size of the huge pages backing the
+ *		regions, 0 if they are not
+ */
+size_t mem_hugepagesize(void){
+	return (mem_huge == MEM_HUGE_NONE) ? 0 : HUGE_PAGESIZE;
+}
+
+/*
+ * mem_hugepages_used() - returns the huge pages the regions got,
+ *		MEM_HUGE_NONE if they did not get the ones asked for
+ */
+int mem_hugepages_used(void){
+	return mem_huge;
 }
 
 /*
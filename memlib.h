@@ -1,11 +1,35 @@
+#include <stdint.h>
 #include <unistd.h>
 
+/* Number of disjoint regions memlib can hand out, each MAX_HEAP bytes */
+#define MEM_REGIONS 64
+
+/* Huge pages backing the regions, see mem_hugepages */
+#define MEM_HUGE_NONE 0     /* Base pages */
+#define MEM_HUGE_THP  1     /* Transparent huge pages (MADV_HUGEPAGE) */
+#define MEM_HUGE_TLB  2     /* Reserved huge pages (MAP_HUGETLB), else THP */
+#define HUGE_PAGESIZE (2 * (1 << 20))
+
 void mem_init(void);               
+void mem_hugepages(int mode);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
+void *mem_region_sbrk(int region, intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_region_lo(int region);
+void *mem_region_hi(int region);
+void *mem_region_zero(int region);
+int mem_region_of(const void *p);
+int mem_in_heap(const void *lo, const void *hi);
+void *mem_map(size_t size);
+void *mem_remap(void *p, size_t oldsize, size_t newsize);
+void mem_unmap(void *p, size_t size);
+void mem_decommit(void *p, size_t size, int lazy);
+size_t mem_resident(void);
 size_t mem_heapsize(void);
+size_t mem_peaksize(void);
+size_t mem_hugepagesize(void);
+int mem_hugepages_used(void);
 size_t mem_pagesize(void);
-
@@ -1,34 +1,185 @@
 /*
- * mm.c - Explicit free list Implementation
+ * mm.c - Segregated explicit free list Implementation
  *
  * Timothy Kaboya - tkaboya
- * HLD Description of my solution 
- * 1. Doubly linked Explicit List
- * 2. First Fit 
+ * HLD Description of my solution
+ * 1. Array of doubly linked explicit lists, one per size class
+ * 2. First Fit inside the request's class, then head of next class
+ * 3. Balanced tree (treap) of large free blocks for Best Fit
+ * 4. Thread safe: per thread caches of small blocks in front of
+ *    several arenas, each an independent heap with its own lock
+ * 5. Slabs of header-less slots for tiny payloads (<= SLAB_MAX)
  *
- *  VIRTUAL MEMORY STRUCTURE 
+ *  VIRTUAL MEMORY STRUCTURE
  *  Free block
  *  [ HEADER | PREV | NEXT |    PAYLOAD    | FOOTER ]
- *  Allocated block
- *  [ HEADER |   PAYLOAD    | FOOTER ]
- *   
- *  Free List Structure
+ *  Allocated block (footer only if built with -DALLOC_FOOTERS)
+ *  [ HEADER |   PAYLOAD    ]
+ *
+ *  Header: size | big bit (4) | prev allocated bit (2) | allocated bit (1).
+ *  Footers are only read to coalesce with a free block before, so
+ *  allocated blocks drop theirs and the next header says whether they
+ *  are allocated. Saves 4 bytes of overhead when the size leaves room.
+ *
+ *  Big blocks (4 GiB and up, only ever free: allocations that big are
+ *  mapped) have a 64 bit header. Header and footer words keep the low 32
+ *  bits of the size and set the big bit; the high bits are in a second
+ *  word, past the purge fields after the header and right before the
+ *  footer. Every other block keeps its one word header.
+ *  Big free block
+ *  [ HEADER | LINKS, PURGE FIELDS | HIGH |  PAYLOAD  | HIGH | FOOTER ]
+ *
+ *  16 byte alignment (build with MMFLAGS=-DALIGN16)
+ *  Payloads are 16 byte aligned, as the x86-64 ABI expects for long
+ *  double and SSE types. The header stays one word right before the
+ *  payload: block sizes are multiples of 16 (MINIMUM 32), so every header
+ *  sits 4 bytes short of a 16 byte boundary and no block needs a padding
+ *  word. Exact classes, slab classes and tcache bins step by 16.
+ *
+ *  Heap Structure (one per arena, in its own memlib region)
+ *  [ ARENA | PAD | PROLOGUE HDR | PROLOGUE FTR | BLOCKS ... | EPILOGUE ]
+ *
+ *  Free List Structure (one per size class)
  *  [NULL  <==  Free 1 <==> Free 2 <==> Free3 <==> ... <==> FreeN ==> NULL]
  *
- * MALLOC - Uses First Fit and if block too big, block is split to
- * create new free block. 
+ *  Large free block (>= TREE_MIN), node of the tree
+ *  [ HEADER | LEFT | RIGHT |    PAYLOAD    | FOOTER ]
+ *
+ *  Size Classes
+ *  Small blocks (<= SMALL_MAX) get one exact class per multiple of
+ *  ALIGNMENT, so any block in the class fits. Bigger blocks share power of two classes.
+ *  The array of class heads lives in the arena, at the bottom of the heap.
+ *  Blocks of TREE_MIN bytes or more skip the lists and go in a treap
+ *  ordered by (size, address). Its heap priority is a hash of the
+ *  address, so nodes only need the LEFT/RIGHT links, kept where free
+ *  list blocks keep PREV/NEXT. Best fit is then one O(log n) descent.
+ *
+ *  Placement
+ *  Class lists are LIFO by default. ADDRESS_ORDER turns each class list
+ *  into a treap ordered by address alone (same links, same priority as
+ *  the large block tree), so inserts and removals are O(log n) and the
+ *  first fit of a class is its leftmost block that fits.
+ *  NEXT_FIT searches a class from a rover left after the last fit.
+ *  The treap of large blocks stays best fit under every policy.
+ *
+ *  REALTIME mode (TLSF style, build with MMFLAGS=-DREALTIME)
+ *  Classes become a two level index: first level is the power of two of
+ *  the size, second level splits each power of two in SL_COUNT ranges.
+ *  A first level bitmap and one second level bitmap per first level
+ *  record the non empty lists, so find_fit is a few ctz instructions and
+ *  malloc/free run in bounded time. The request is rounded up to the
+ *  next class so the head of any list found always fits (good fit).
+ *  There is no tree in this mode, the big classes are lists too.
  *
- * FREE - Find block and set its alloc bits to 0. Then append newly freed block
+ *  Slabs
+ *  Payloads of up to SLAB_MAX bytes (one class per ALIGNMENT bytes) are
+ *  slots in SLAB_SIZE slabs instead of heap blocks, with no header or
+ *  footer. Slabs are SLAB_SIZE aligned, in a region of their own per
+ *  arena, so a slot is known to be one by its region and its slab header
+ *  (slot size, bitmap of used slots) is found by masking its address.
+ *  Partly full slabs of a class are on a list of the arena, empty ones on
+ *  a list any class can reuse. Slabs are smaller than a page: utilization
+ *  counts the whole slab as soon as one slot is used. So a class gets its
+ *  first slab only after SLAB_WARM requests, served as heap blocks.
+ *  [ SLAB HEADER | MAP | SLOT | SLOT | ... | SLOT | PAD ]
+ *
+ *  Huge Blocks
+ *  Requests of mmap_threshold bytes (MMAP_THRESHOLD unless changed with
+ *  mm_mallopt) or more skip the arenas: each gets a mapping of its own
+ *  from memlib, its length stored MAP_HDR bytes before the payload and
+ *  the payload offset in the mapping right after (more than MAP_HDR for
+ *  aligned blocks). They
+ *  are known by lying outside every region. free unmaps them, so they
+ *  never raise the heap high water mark for good, and realloc resizes
+ *  them with mremap.
+ *
+ *  Purging
+ *  Free blocks of PURGE_MIN bytes or more are also on the dirty list of
+ *  their arena, oldest first. The decay clock ticks on every free that
+ *  reaches the arena (not wall time, so traces replay the same way). A
+ *  block purge_decay ticks old has the whole pages of its payload (past
+ *  the links and purge fields) given back lazily with MADV_FREE, and
+ *  goes to the back of the list, muzzy. After as many ticks again they
+ *  are dropped for good with MADV_DONTNEED and the block leaves the list,
+ *  clean. Each large free block counts its dropped bytes, which will
+ *  fault back in once allocated; merged blocks add theirs up, split ones
+ *  keep what fits in the free part. mm_trim purges every block at once.
+ *
+ *  Arenas
+ *  Up to NARENAS arenas, each one a complete heap (class lists, tree,
+ *  prologue/epilogue) with its own lock, grown in its own memlib region.
+ *  A thread is bound to arena sched_getcpu() % NARENAS on its first call
+ *  (round robin if built with -DARENA_ROUND_ROBIN or if the cpu is
+ *  unknown). Arena i lives at the start of region i, so the arena that
+ *  owns a block follows from the block address: frees always go back to
+ *  the owner, whatever thread makes them.
+ *
+ *  Thread Caches (tcache)
+ *  Each thread owns TCACHE_BINS singly linked bins of freed small blocks
+ *  (heap blocks and slab slots), one per block size up to TCACHE_MAX.
+ *  Slots are never bigger than SLAB_MAX and heap blocks handed out never
+ *  smaller, so both kinds share the bins.
+ *  Cached blocks stay marked allocated in the heap (or their slab). A
+ *  malloc hit pops its bin and a free pushes, both without any lock. A
+ *  bin holding more than TCACHE_FILL blocks, or pushed on while the
+ *  whole cache holds more than TCACHE_BYTES, hands half of them back: to
+ *  the thread's arena under a single lock, to the others through their
+ *  remote lists. The cache itself is allocated from the arena.
+ *  mm_init bumps the heap epoch, which invalidates arenas and caches of
+ *  the old heap in every thread.
+ *
+ *  Remote Frees
+ *  A thread never takes the lock of an arena that is not its own. Blocks
+ *  of another arena (from free, or from a tcache flush) are pushed on
+ *  that arena's remote list, an atomic singly linked stack (many
+ *  producers, one consumer). The next malloc that takes the owner's lock
+ *  swaps the whole stack out and frees it there. Until then these blocks
+ *  stay marked allocated, like cached ones.
+ *
+ * MALLOC - Start at the class of the request. Exact classes just pop the
+ * head, power of two classes are searched first fit. If class has no fit
+ * take head of next non empty class, and best fit from the tree when the
+ * lists have nothing. If block too big, block is split to create new
+ * free block.
+ *
+ * FREE - Heap blocks of up to quick_max bytes go on the quick list of
+ * their exact size, still marked allocated, where malloc of that size
+ * takes them back first. The quick lists are coalesced in bulk when they
+ * hold QUICK_BYTES, or when malloc finds no fit in the free lists.
+ * Other blocks: find block and set its alloc bits to 0. Then append newly freed block
  * using the coalesce function that coalesces it w/ free neighbours
+ * If that leaves a free block of 2 * trim_threshold bytes or more at the
+ * top of the heap, the heap shrinks to keep trim_threshold of it (see
+ * also mm_trim). Then the large free blocks that decayed are purged.
+ *
+ * REALLOC - If new size < old size, truncate the block in place
+ * if remaining block is larger than mini free it.
+ * When new size > old size, absorb the next block if free and big
+ * enough, extending the heap first if the block is the last one.
+ * Else (or for a block of another arena) copy to a new block.
  *
- * REALLOC - If new size < old size, truncate new block
- * if remaining block is larger than mini add it to free list 
- * When new size > old size, just copy old size till its end
+ * CALLOC - Malloc for given size and then all blocks to zero. Huge
+ * blocks are fresh mappings and skip the clear. Large free blocks (those
+ * with purge fields) also keep one range of bytes known to be zero: where
+ * the heap grew past the region's zero mark (mem_region_zero), or pages
+ * dropped by a purge. Merges keep the largest range (or the union of
+ * touching ones), splits what falls in each part, and calloc clears only
+ * the payload bytes outside it.
  *
- * CALLOC - Malloc for given size and then all blocks to zero. 
+ * MEMALIGN - Allocate a block with room for the alignment and a leading
+ * free block, free the part before the first aligned payload that leaves
+ * room for it, then shrink the block in place like realloc.
+ *
+ * BATCH - mm_malloc_batch places one block for a run of same sized blocks
+ * and cuts it up, one find_fit and one split per run. mm_free_batch sorts
+ * the blocks and frees each run of heap neighbours as one block.
  *
  */
+#define _GNU_SOURCE             /* sched_getcpu */
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,6 +195,11 @@
 #define free mm_free
 #define realloc mm_realloc
 #define calloc mm_calloc
+#define memalign mm_memalign
+#define posix_memalign mm_posix_memalign
+#define aligned_alloc mm_aligned_alloc
+#define malloc_usable_size mm_malloc_usable_size
+#define free_sized mm_free_sized
 #define checkheap mm_checkheap
 #endif /* def DRIVER */
 
@@ -59,26 +215,78 @@
 
 
 /* Basic constants and macros */
-#define WSIZE       4       /* Word and header/footer size (bytes) */ 
+#define WSIZE       4       /* Word and header/footer size (bytes) */
 #define DSIZE       8       /* Double word size (bytes) */
-#define CHUNKSIZE  (1<<8)  /* Extend heap by this amount (bytes) */  
-#define ALIGNMENT 8         /* single word (4) or double word (8) alignment */
+#define CHUNKSIZE  (1<<8)  /* Extend heap by this amount (bytes) */
+#ifdef ALIGN16
+#define ALIGN_SHIFT 4       /* log2(ALIGNMENT) */
+#define MINIMUM   32
+#else
+#define ALIGN_SHIFT 3
 #define MINIMUM   24
+#endif
+#define ALIGNMENT (1 << ALIGN_SHIFT) /* Payload alignment (bytes) */
+
+/* Size classes */
+#ifdef REALTIME
+#define SL_SHIFT    3       /* log2(SL_COUNT) */
+#define SL_COUNT    (1 << SL_SHIFT)  /* Second level lists per first level */
+#define FL_SHIFT    (SL_SHIFT + ALIGN_SHIFT) /* Below 1 << FL_SHIFT, lists are exact */
+#define FL_COUNT    27      /* First level 0 is the exact small lists */
+#define NUM_CLASSES (FL_COUNT * SL_COUNT)
+#else
+#define SMALL_MAX   128     /* Largest block size with an exact class */
+#define NUM_SMALL   ((SMALL_MAX - MINIMUM) / ALIGNMENT + 1)
+#define SMALL_SHIFT 7       /* log2(SMALL_MAX) */
+#define TREE_SHIFT  10      /* log2(TREE_MIN) */
+#define TREE_MIN    (1 << TREE_SHIFT) /* Smallest block kept in the tree */
+#define NUM_CLASSES (NUM_SMALL + TREE_SHIFT - SMALL_SHIFT)
+#endif
 
 #define MAX(x, y) ((x) > (y)? (x) : (y))
+#define MIN(x, y) ((x) < (y)? (x) : (y))
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc)  ((size) | (alloc))
 
+/* Header bit: the block before this one is allocated */
+#define PREV_ALLOC  0x2
+
+/* Block bytes that are not payload, and block size for a payload */
+#ifdef ALLOC_FOOTERS
+#define OVERHEAD    DSIZE   /* Header and footer */
+#else
+#define OVERHEAD    WSIZE   /* Header only, allocated blocks lose the footer */
+#endif
+#define ASIZE(size) MAX(ALIGN((size) + OVERHEAD), MINIMUM)
+
 /* Read and write a word at address p */
 #define GET(p)       (*(unsigned int *)(p))
 #define PUT(p, val)  (*(unsigned int *)(p) = (val))
 
-/* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
+/* Header and footer bit: the size has more than 32 bits (see HDR_HI) */
+#define BIG         0x4
+#define BIG_MIN     ((size_t)1 << 32) /* Smallest big block */
+
+/* Given the header (footer) at p of a big block, its high size word */
+#define HDR_HI(p)    ((char *)(p) + WSIZE + 7 * DSIZE)
+#define FTR_HI(p)    ((char *)(p) - WSIZE)
+
+/* Read the size and allocated fields from header address p */
+#define GET_SIZE(p)  ((size_t)(GET(p) & ~0x7) | \
+        ((GET(p) & BIG) ? (size_t)GET(HDR_HI(p)) << 32 : 0))
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+
+/* Read the size from footer address p */
+#define FTR_SIZE(p)  ((size_t)(GET(p) & ~0x7) | \
+        ((GET(p) & BIG) ? (size_t)GET(FTR_HI(p)) << 32 : 0))
+
+/* Set, clear the prev allocated bit of the header at p */
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
 
 /* Given block ptr ptr, compute address of its header and footer */
 #define HDRP(ptr)       ((char *)(ptr) - WSIZE)
@@ -86,115 +294,464 @@
 
 /* Given block ptr ptr, compute address of next and previous blocks */
 #define NEXT_BLKP(ptr)  ((char *)(ptr) + GET_SIZE(HDRP(ptr)))
-#define PREV_BLKP(ptr)  ((char *)(ptr) - GET_SIZE(HDRP(ptr) - WSIZE))
+#define PREV_BLKP(ptr)  ((char *)(ptr) - FTR_SIZE(HDRP(ptr) - WSIZE))
 
 /* Given free list ptr, compute address of next and previous free list ptrs */
 #define NEXT_FREEP(ptr)  (*(char **)((char *)(ptr) + DSIZE))
 #define PREV_FREEP(ptr)  (*(char **)((char * )(ptr)))
 
+/* Head of the free list of size class idx */
+#define SEG_LIST(a, idx) ((a)->seg_list[(idx)])
+
+/* Arenas: arena i grows its heap in region i, its slabs in region
+ * NARENAS + i */
+#define NARENAS     32
+#define ARENA(idx)       ((arena_t *)mem_region_lo(idx))
+#define ARENA_OF(ptr)    ARENA(mem_region_of(ptr) % NARENAS)
+
+/* Slabs of tiny blocks */
+#define SLAB_SHIFT  9       /* log2(SLAB_SIZE) */
+#define SLAB_SIZE   (1 << SLAB_SHIFT) /* Slab size, and alignment */
+#define SLAB_MAX    32      /* Largest payload kept in slabs */
+#define SLAB_WARM   4       /* Heap blocks a class takes before a slab */
+#define SLAB_CLASSES (SLAB_MAX / ALIGNMENT)
+#define SLAB_WORDS  (SLAB_SIZE / DSIZE / 64) /* Bitmap words per slab */
+#define SLAB_FIRST  ALIGN(sizeof(slab_t)) /* Offset of the first slot */
+#define SLAB_IDX(psize)   ((psize) / ALIGNMENT - 1)
+#define SLAB_REGION(a)    (NARENAS + (a)->region)
+#define SLAB_OF(ptr)      ((slab_t *)((size_t)(ptr) & ~(size_t)(SLAB_SIZE - 1)))
+#define IN_SLAB(ptr)      (mem_region_of(ptr) >= NARENAS)
+
+/* Size of the block (or slab slot) at ptr */
+#define BLOCK_SIZE(ptr)   (IN_SLAB(ptr) ? SLAB_OF(ptr)->size : GET_SIZE(HDRP(ptr)))
+
+/* Huge blocks, each in a mapping of its own: mapping length and payload
+ * offset in the MAP_HDR bytes before the payload */
+#define MMAP_THRESHOLD (128 * 1024) /* Default smallest mmapped request */
+#define TRIM_THRESHOLD (128 * 1024) /* Default free top released by free */
+#define MAP_HDR     (2 * DSIZE)
+#define IS_MAPPED(ptr)    (mem_region_of(ptr) < 0)
+#define MAP_LEN(ptr)      (*(size_t *)((char *)(ptr) - MAP_HDR))
+#define MAP_OFF(ptr)      (*(size_t *)((char *)(ptr) - DSIZE))
+
+/* Purging of large free blocks: their dirty list links and purge fields
+ * follow the free list (or tree) links */
+#define PURGE_MIN   (1 << 14) /* Smallest free block purged */
+#define PURGE_DECAY 1024    /* Default ticks before each purge stage */
+#define PURGE_HDR   (10 * DSIZE) /* Payload bytes never purged */
+#define DIRTY_PREV(ptr)   (*(char **)((char *)(ptr) + 2 * DSIZE))
+#define DIRTY_NEXT(ptr)   (*(char **)((char *)(ptr) + 3 * DSIZE))
+#define PURGE_STAMP(ptr)  (*(unsigned long *)((char *)(ptr) + 4 * DSIZE))
+#define PURGE_STATE(ptr)  (*(unsigned long *)((char *)(ptr) + 5 * DSIZE))
+#define PURGED(ptr)       (*(size_t *)((char *)(ptr) + 6 * DSIZE))
+#define PURGED_OF(ptr)    ((GET_SIZE(HDRP(ptr)) >= PURGE_MIN) ? PURGED(ptr) : 0)
+#define ZERO_LO(ptr)      (*(char **)((char *)(ptr) + 8 * DSIZE))
+#define ZERO_HI(ptr)      (*(char **)((char *)(ptr) + 9 * DSIZE))
+#define PURGE_DIRTY 0       /* Every page there */
+#define PURGE_MUZZY 1       /* Pages given back with MADV_FREE */
+#define PURGE_CLEAN 2       /* Pages dropped, off the dirty list */
+
+/* Thread caches */
+#define TCACHE_MAX  256     /* Largest block size cached per thread */
+#define TCACHE_BINS (TCACHE_MAX / ALIGNMENT)
+#define TCACHE_FILL 16      /* Blocks a bin may hold before flushing */
+#define TCACHE_BYTES 4096   /* Bytes all bins may hold before flushing */
+#define TCACHE_IDX(bsize) ((bsize) / ALIGNMENT - 1)
+#define TCACHE_SIZE(idx)  ((size_t)((idx) + 1) * ALIGNMENT)
+#define TCACHE_NEXT(ptr)  (*(char **)(ptr))
+
+/* Quick lists: freed heap blocks not coalesced yet, per arena */
+#define QUICK_MAX   256     /* Default largest block size kept, 0 for none */
+#define QUICK_LIMIT 1024    /* Largest quick_max allowed */
+#define QUICK_BINS  (QUICK_LIMIT / ALIGNMENT)
+#define QUICK_BYTES (64 * 1024) /* Bytes in the quick lists forcing a merge */
+#define QUICK_IDX(bsize)  ((bsize) / ALIGNMENT - 1)
+#define QUICK_NEXT(ptr)   (*(char **)(ptr))
+
+/* Placement policy of the class lists, MM_PLACE_* (see mm_mallopt) */
+#if defined(ADDRESS_ORDER)
+#define PLACEMENT   MM_PLACE_ADDRESS
+#elif defined(NEXT_FIT)
+#define PLACEMENT   MM_PLACE_NEXT_FIT
+#else
+#define PLACEMENT   MM_PLACE_LIFO
+#endif
+#if defined(REALTIME) && PLACEMENT != MM_PLACE_LIFO
+#error "REALTIME lists are LIFO only"
+#endif
+
+/* Given block ptr on a remote free list, the next one */
+#define REMOTE_NEXT(ptr)  (*(char **)(ptr))
+
+/* Index of the highest set bit of a non zero size */
+#define FLS(x)           (63 - __builtin_clzl(x))
+
+/* Given tree node ptr, its children (stored like the list links) */
+#define LEFT(ptr)        PREV_FREEP(ptr)
+#define RIGHT(ptr)       NEXT_FREEP(ptr)
+
+/* Tree order: by size, then by address. Trees of address ordered class
+ * lists hold only blocks below TREE_MIN, and go by address alone.
+ * Priority: hash of address */
+#define TREE_LESS(x, y)  ((GET_SIZE(HDRP(x)) < TREE_MIN) ? ((x) < (y)) : \
+        (GET_SIZE(HDRP(x)) < GET_SIZE(HDRP(y))) || \
+        ((GET_SIZE(HDRP(x)) == GET_SIZE(HDRP(y))) && ((x) < (y))))
+#define PRIORITY(ptr)    (((size_t)(ptr) * 0x9E3779B97F4A7C15UL) >> 32)
+
+/*
+ * Slab: SLAB_SIZE bytes (and aligned), slots of one size after this
+ * header. Slots have no header or footer; the slab of a slot is found by
+ * masking its address.
+ */
+typedef struct slab {
+    struct slab *prev, *next;   /* Partial slabs of the class, or empty */
+    unsigned int size;          /* Slot size, 0 while the slab is empty */
+    unsigned int used;          /* Slots in use */
+    unsigned int nslots;        /* Slots in the slab */
+    unsigned long map[SLAB_WORDS]; /* Bit set: slot used (or past the end) */
+} slab_t;
+
+/*
+ * Arena: one independent heap. Stored at the bottom of its own region,
+ * any access to it (or to its blocks) needs its lock.
+ */
+typedef struct {
+    pthread_mutex_t lock;       /* Taken by any operation on this arena */
+    char *heap_listp;           /* Pointer to first block */
+    int region;                 /* memlib region the heap grows in */
+    char *remote;               /* Blocks freed by other threads, no lock */
+#ifdef REALTIME
+    unsigned int fl_bitmap;     /* Bit fl set: some list of fl non empty */
+    unsigned int sl_bitmap[FL_COUNT]; /* Per fl, bit sl set: list non empty */
+#else
+    char *tree_root;            /* Root of the tree of large free blocks */
+#endif
+    char *seg_list[NUM_CLASSES]; /* Class list heads */
+    slab_t *slabs[SLAB_CLASSES]; /* Slabs with a free slot, per class */
+    slab_t *slab_empty;         /* Empty slabs, any class can take them */
+    unsigned int slab_warm[SLAB_CLASSES]; /* Heap blocks taken, per class */
+    char *dirty, *dirty_tail;   /* Large free blocks not clean, oldest first */
+    unsigned long tick;         /* Decay clock: frees so far */
+    size_t purged;              /* Bytes dropped from free blocks */
+    char *zero_lo, *zero_hi;    /* Known zero bytes of the last block placed */
+    char **quick;               /* Quick list heads, allocated on first use */
+    size_t quick_bytes;         /* Bytes in the quick lists */
+    int policy;                 /* Placement, MM_PLACE_*, set when built */
+    char *rover;                /* Next fit: list block the next search starts at */
+} arena_t;
+
 /* Global variables */
-static char *heap_listp = 0;  /* Pointer to first block */
-static char *free_listp = 0;   /* Pointer to list to list of free blocks */ 
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long arena_ready = 0;  /* Bit i set: arena i initialized */
+static unsigned int arena_next = 0;    /* Next arena for round robin */
+static unsigned int heap_epoch = 0;    /* Bumped by every mm_init */
+static size_t mmap_threshold = MMAP_THRESHOLD; /* See mm_mallopt */
+static size_t trim_threshold = TRIM_THRESHOLD; /* See mm_mallopt */
+static size_t purge_decay = PURGE_DECAY; /* See mm_mallopt */
+static size_t quick_max = QUICK_MAX;     /* See mm_mallopt */
+static int placement = PLACEMENT;        /* See mm_mallopt */
+
+static __thread arena_t *thread_arena = 0;  /* Arena of this thread */
+static __thread unsigned int arena_epoch = 0; /* Heap epoch of thread_arena */
+
+/* Per thread cache of small freed blocks, allocated from the heap */
+typedef struct {
+    char *bins[TCACHE_BINS];           /* Cached blocks, by exact size */
+    unsigned int count[TCACHE_BINS];   /* Number of blocks in each bin */
+    size_t bytes;                      /* Bytes in all bins */
+} tcache_t;
+
+static __thread tcache_t *tcache = 0;
+static __thread unsigned int tcache_epoch = 0; /* Heap epoch of tcache */
+static pthread_key_t tcache_key;     /* Flushes the cache at thread exit */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
 
 /* Function prototypes for internal helper routines */
-static void *extend_heap(size_t words);
-static void place(void *ptr, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *ptr);
+static void *extend_heap(arena_t *a, size_t words);
+static void place(arena_t *a, void *ptr, size_t asize);
+static void *find_fit(arena_t *a, size_t asize);
+static void *coalesce(arena_t *a, void *ptr, size_t purged);
+static void zero_merge(char **lo, char **hi, char *zlo, char *zhi);
+static void zero_of(char *ptr, char **lo, char **hi);
+static void zero_add(char *ptr, char *lo, char *hi);
 /* My own helpers: :) */
 static void printblock(void *ptr);
 static void checkblock(void *ptr);
-static void insertfreeblock(void *ptr);
-static void removefreeblock(void *ptr);
-static int freelistedge(void *ptr);
+static void insertfreeblock(arena_t *a, void *ptr);
+static void removefreeblock(arena_t *a, void *ptr);
+static void setfreeblock(void *ptr, size_t size, size_t prev_alloc);
+static int sizeclass(size_t asize);
+static int arena_init(int idx);
+static arena_t *arena_get(void);
+static void checkheap_locked(arena_t *a, int lineno);
+static void *heap_alloc(arena_t *a, size_t asize);
+static void heap_free(arena_t *a, void *ptr);
+static void heap_release(arena_t *a, void *ptr);
+static int quick_init(arena_t *a);
+static void quick_merge(arena_t *a);
+static void *heap_realloc(arena_t *a, void *ptr, size_t asize);
+static void *heap_memalign(arena_t *a, size_t align, size_t asize);
+static int arena_trim(arena_t *a, size_t pad);
+static int arena_purge(arena_t *a, int all);
+static void dirty_link(arena_t *a, char *ptr);
+static void dirty_unlink(arena_t *a, char *ptr);
+static tcache_t *tcache_get(void);
+static void tcache_flush(tcache_t *tc, int idx, unsigned int n);
+static int tcache_reclaim(arena_t *a);
+static void tcache_destroy(void *arg);
+static void tcache_keyinit(void);
+static void remote_push(arena_t *a, char *first, char *last);
+static void remote_drain(arena_t *a);
+static size_t usable_size(void *ptr);
+static void free_block(void *ptr, size_t size);
+static void heap_split(char *ptr, size_t bsize, size_t k, void **out);
+static int ptr_cmp(const void *x, const void *y);
+static void *map_alloc(size_t size, size_t align);
+static void *map_realloc(void *ptr, size_t size);
+static void *slab_alloc(arena_t *a, size_t psize);
+static void slab_free(arena_t *a, void *ptr);
+static void slab_link(arena_t *a, slab_t *s);
+static void slab_unlink(arena_t *a, slab_t *s);
+static int slab_check(arena_t *a);
+#ifndef REALTIME
+static void tree_insert(char **link, char *ptr);
+static void tree_remove(char **root, char *ptr);
+static void *tree_fit(arena_t *a, size_t asize);
+static void *tree_first(char *ptr, size_t asize);
+static int tree_check(char *ptr, int idx, char *lo, char *hi);
+#endif
 /*
  * Initialize memory manager: return -1 on error, 0 on success.
- * Memory is essentially one huge block that is in free list. 
+ * Forgets every arena and thread cache of the old heap, then sets up
+ * the arena of the calling thread.
  */
 int mm_init(void) {
+    pthread_mutex_lock(&arena_lock);
+    arena_ready = 0;
+    arena_next = 0;
+    heap_epoch++;
+    pthread_mutex_unlock(&arena_lock);
 
-    /* Create the initial empty heap(free list) */
-    if ((heap_listp = mem_sbrk(2*MINIMUM)) == (void *)-1) 
-        return -1;
-    PUT(heap_listp, 0);                          /* Alignment padding */
-    PUT(heap_listp + (1*WSIZE), PACK(MINIMUM, 1)); /* Prologue header */ 
-    PUT(heap_listp + (2*WSIZE), 0); /* Previous pointer */
-    PUT(heap_listp + (3*WSIZE), 0);    /* Next Pointer */
-
-    PUT(heap_listp + MINIMUM, PACK(MINIMUM, 1));      /* Prologue footer */
-    PUT(heap_listp + MINIMUM + WSIZE, PACK(0, 1));    /* Epilogue Header */
-
-    free_listp = heap_listp + DSIZE;
+    return (arena_get() == NULL) ? -1 : 0;
+}
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
-        return -1;
+/*
+ * mm_mallopt - Set tunable param to value. Returns 1 on success, 0 for
+ *              an unknown param or a bad value.
+ *              MM_MMAP_THRESHOLD: requests of value bytes or more get a
+ *              mapping of their own.
+ *              MM_TRIM_THRESHOLD: free gives back the free block at the
+ *              top of a heap once it has twice value bytes, keeping value
+ *              bytes (negative: never).
+ *              MM_PURGE_DECAY: large free blocks are purged lazily value
+ *              frees after they were freed, for good as many frees later
+ *              (negative: never).
+ *              MM_QUICK_MAX: freed heap blocks of up to value bytes (at
+ *              most QUICK_LIMIT) wait on quick lists and are coalesced in
+ *              bulk (0: coalesce every block as it is freed).
+ *              MM_PLACEMENT: order of the class lists of arenas built
+ *              from then on (next mm_init): MM_PLACE_LIFO, _ADDRESS or
+ *              _NEXT_FIT. REALTIME builds only have MM_PLACE_LIFO.
+ */
+int mm_mallopt(int param, int value) {
+    switch (param) {
+    case MM_MMAP_THRESHOLD:
+        if (value <= 0)
+            return 0;
+        mmap_threshold = value;
+        return 1;
+    case MM_TRIM_THRESHOLD:
+        trim_threshold = (value < 0) ? (size_t)-1 : (size_t)value;
+        return 1;
+    case MM_PURGE_DECAY:
+        purge_decay = (value < 0) ? (size_t)-1 : (size_t)value;
+        return 1;
+    case MM_QUICK_MAX:
+        if (value < 0 || value > QUICK_LIMIT)
+            return 0;
+        quick_max = value;
+        return 1;
+    case MM_PLACEMENT:
+        if (value < MM_PLACE_LIFO || value > MM_PLACE_NEXT_FIT)
+            return 0;
+#ifdef REALTIME
+        if (value != MM_PLACE_LIFO)
+            return 0;
+#endif
+        placement = value;
+        return 1;
+    default:
+        return 0;
+    }
+}
 
-    return 0;
+/*
+ * mm_trim - Give the free block at the top of every heap back to the
+ *           system, but for pad bytes of it, and purge every large free
+ *           block. Quick lists are merged first. Returns 1 if any memory
+ *           was released, 0 if not.
+ */
+int mm_trim(size_t pad) {
+    int idx, released = 0;
+    arena_t *a;
+
+    for (idx = 0; idx < NARENAS; idx++) {
+        if (!(arena_ready & (1UL << idx)))
+            continue;
+        a = ARENA(idx);
+        pthread_mutex_lock(&a->lock);
+        remote_drain(a);
+        quick_merge(a);
+        released |= arena_trim(a, pad);
+        released |= arena_purge(a, 1);
+        pthread_mutex_unlock(&a->lock);
+    }
+    return released;
 }
 
 /*
  * malloc - Allocate a block with at least size bytes of payload
+ *          Small sizes are served from the thread cache when it has a
+ *          block, huge ones get their own mapping, anything else goes to
+ *          the thread's arena under its lock: a slab slot for tiny sizes,
+ *          else a heap block.
  */
 void *malloc (size_t size) {
-    size_t asize;      /* Adjusted block size */
-    size_t extendsize; /* Amount to extend heap if no fit */
-    char *ptr;  
-
-    if (heap_listp == 0){
-        mm_init();
-    }
+    size_t bsize;      /* Slot or adjusted block size */
+    tcache_t *tc;
+    arena_t *a;
+    char *ptr;
 
     /* Ignore spurious requests */
     if (size == 0)
         return NULL;
 
-    /* Adjust block size to include overhead and alignment reqs. */
-    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    if (size >= mmap_threshold)
+        return map_alloc(size, ALIGNMENT);
 
-    /* Search the free list for a fit */
-    if ((ptr = find_fit(asize)) != NULL) {  
-        place(ptr, asize);       
-        return ptr;
+    /* Adjust block size to include overhead and alignment reqs. */
+    bsize = (ALIGN(size) <= SLAB_MAX) ? ALIGN(size) : ASIZE(size);
+
+    /* Thread cache hit: no locking */
+    if (bsize <= TCACHE_MAX && (tc = tcache_get()) != NULL) {
+        int idx = TCACHE_IDX(bsize);
+        if ((ptr = tc->bins[idx]) != NULL) {
+            tc->bins[idx] = TCACHE_NEXT(ptr);
+            tc->count[idx]--;
+            tc->bytes -= bsize;
+            return ptr;
+        }
     }
 
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize,CHUNKSIZE);                 
-    if ((ptr = extend_heap(extendsize/WSIZE)) == NULL)  
-        return NULL;                                  
-    place(ptr, asize);                                 
+    if ((a = arena_get()) == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    if (bsize <= SLAB_MAX)
+        ptr = slab_alloc(a, bsize);
+    else
+        ptr = heap_alloc(a, bsize);
+    pthread_mutex_unlock(&a->lock);
 
     return ptr;
 }
 
 /*
  * free - Free a block
+ *        Small blocks go in the thread cache (still marked allocated).
+ *        The rest are freed in the arena owning them under its lock if
+ *        it is the thread's arena, else pushed on its remote free list.
  */
 void free (void *ptr) {
+    if (ptr == 0)
+        return;
 
-    if (ptr == 0) 
+    if (IS_MAPPED(ptr)) {
+        mem_unmap((char *)ptr - MAP_OFF(ptr), MAP_LEN(ptr));
         return;
+    }
 
-    size_t size = GET_SIZE(HDRP(ptr));
-    if (heap_listp == 0){
-        mm_init();
+    free_block(ptr, BLOCK_SIZE(ptr));
+}
+
+/*
+ * free_sized - Free a block of size bytes, the size it was asked with
+ *              (by malloc, calloc or realloc). A slot size follows from
+ *              it, so slab slots skip the read of their slab header. Heap
+ *              blocks can be bigger than asked (a split remainder too
+ *              small to be a block stays in), they still read theirs.
+ *              Built with -DDEBUG, checks the size against the block.
+ */
+void free_sized(void *ptr, size_t size) {
+    if (ptr == 0)
+        return;
+
+#ifdef DEBUG
+    if (size > usable_size(ptr) ||
+            (IN_SLAB(ptr) && ALIGN(size) != SLAB_OF(ptr)->size)) {
+        printf("Addr: %p - ** Sized Free Error** (%zu bytes)\n", ptr, size);
+        assert(0);
+    }
+#endif
+
+    if (IS_MAPPED(ptr)) {
+        mem_unmap((char *)ptr - MAP_OFF(ptr), MAP_LEN(ptr));
+        return;
     }
 
-    /* Set header, footer alloc bits to zero */
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
+    free_block(ptr, IN_SLAB(ptr) ? ALIGN(size) : GET_SIZE(HDRP(ptr)));
+}
+
+/*
+ * malloc_usable_size - Payload bytes of the block at ptr, at least what
+ *                      was asked for it: the caller may use all of them
+ */
+size_t malloc_usable_size(void *ptr) {
+    return (ptr == 0) ? 0 : usable_size(ptr);
+}
+
+/*
+ * free_block - free (or free_sized) of the heap block or slab slot ptr,
+ *              of size bytes
+ */
+static void free_block(void *ptr, size_t size) {
+    tcache_t *tc;
+    arena_t *a;
+
+    if (size <= TCACHE_MAX && (tc = tcache_get()) != NULL) {
+        int idx = TCACHE_IDX(size);
+        TCACHE_NEXT(ptr) = tc->bins[idx];
+        tc->bins[idx] = ptr;
+        tc->bytes += size;
+        if (++tc->count[idx] > TCACHE_FILL || tc->bytes > TCACHE_BYTES)
+            tcache_flush(tc, idx, (tc->count[idx] + 1) / 2);
+        return;
+    }
 
-    coalesce(ptr);
+    a = ARENA_OF(ptr);
+    if (a != thread_arena || arena_epoch != heap_epoch) {
+        remote_push(a, ptr, ptr);
+        return;
+    }
+    pthread_mutex_lock(&a->lock);
+    heap_free(a, ptr);
+    pthread_mutex_unlock(&a->lock);
 }
 
 /*
- * realloc - Naive implementation of realloc
+ * realloc - Resize in place when the block is in the thread's arena
+ *           (see heap_realloc), else move the data to a new block.
+ *           A slot stays in place only for a size of the same class.
+ *           Mapped blocks staying huge are remapped, never copied.
  */
 void *realloc(void *ptr, size_t size) {
     size_t oldsize, asize;
     void *newptr;
+    arena_t *a;
 
-    asize = MAX(ALIGN(size) + DSIZE, MINIMUM);
+    /* Heap blocks never shrink into slot sizes */
+    asize = MAX(ASIZE(size), ASIZE(SLAB_MAX + 1));
     /* If size == 0 then this is just free, and we return NULL. */
     if(size == 0) {
         free(ptr);
@@ -206,11 +763,28 @@ void *realloc(void *ptr, size_t size) {
         return malloc(size);
     }
 
-    /* Original block size */
-    oldsize = GET_SIZE(HDRP(ptr));
+    /* Original payload size */
+    oldsize = usable_size(ptr);
+
+    if (IS_MAPPED(ptr)) {
+        if (size >= mmap_threshold)
+            return map_realloc(ptr, size);
+    }
+    else if (size < mmap_threshold) {
+        /* If new size needs the same block, just return */
+        if (IN_SLAB(ptr) ? ALIGN(size) == oldsize : asize == GET_SIZE(HDRP(ptr)))
+            return ptr;
 
-    /* If new size is same as old, just return */
-    if (asize == oldsize)  return ptr;
+        /* Try to shrink or grow the block where it is */
+        a = ARENA_OF(ptr);
+        if (!IN_SLAB(ptr) && a == thread_arena && arena_epoch == heap_epoch) {
+            pthread_mutex_lock(&a->lock);
+            newptr = heap_realloc(a, ptr, asize);
+            pthread_mutex_unlock(&a->lock);
+            if (newptr != NULL)
+                return newptr;
+        }
+    }
 
     newptr = mm_malloc(size);
 
@@ -231,25 +805,242 @@ void *realloc(void *ptr, size_t size) {
 
 /*
  * calloc - Allocate the block and set it to zero
- *
+ *          NULL if nmemb * size does not fit in a size_t
+ *          Huge blocks are fresh mappings, already zero. Small ones are
+ *          cleared whole. Large heap blocks skip the bytes place knows
+ *          are still zero (see zero_add).
  */
 void *calloc (size_t nmemb, size_t size) {
     size_t bytes = nmemb * size;
-    void *newptr;
+    size_t asize = ASIZE(bytes);
+    char *newptr, *lo, *hi, *end;
+    arena_t *a;
+
+    if (size != 0 && bytes / size != nmemb)
+        return NULL;
+    if (bytes >= mmap_threshold)
+        return malloc(bytes);
+
+    if (asize < PURGE_MIN) {
+        if ((newptr = malloc(bytes)) != NULL)
+            memset(newptr, 0, bytes);
+        return newptr;
+    }
 
-    newptr = malloc(bytes);
-    memset(newptr, 0, bytes);
+    if ((a = arena_get()) == NULL)
+        return NULL;
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    newptr = heap_alloc(a, asize);
+    lo = a->zero_lo;
+    hi = a->zero_hi;
+    pthread_mutex_unlock(&a->lock);
+    if (newptr == NULL)
+        return NULL;
+
+    /* Clear the payload but for its known zero bytes [lo, hi) */
+    end = newptr + bytes;
+    lo = MAX(lo, newptr);
+    hi = MIN(hi, end);
+    if (lo >= hi)
+        lo = hi = end;
+    memset(newptr, 0, lo - newptr);
+    if (hi < end)
+        memset(hi, 0, end - hi);
 
     return newptr;
 }
 
+/*
+ * memalign - Allocate a block of size bytes whose payload is aligned to
+ *            alignment, a power of two. NULL if it is not one.
+ *            Huge blocks get a mapping of their own, aligned in it;
+ *            others are cut out of a heap block (see heap_memalign).
+ */
+void *memalign(size_t alignment, size_t size) {
+    size_t asize;
+    arena_t *a;
+    char *ptr;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+    if (alignment <= ALIGNMENT)
+        return malloc(size);
+    if (size == 0)
+        return NULL;
+
+    if (size >= mmap_threshold)
+        return map_alloc(size, alignment);
+
+    if ((a = arena_get()) == NULL)
+        return NULL;
+
+    /* Heap blocks never shrink into slot sizes */
+    asize = MAX(ASIZE(size), ASIZE(SLAB_MAX + 1));
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    ptr = heap_memalign(a, alignment, asize);
+    pthread_mutex_unlock(&a->lock);
+
+    return ptr;
+}
+
+/*
+ * posix_memalign - memalign, returning the block in *memptr. Returns
+ *                  EINVAL if alignment is not a power of two multiple of
+ *                  sizeof(void *), ENOMEM if out of memory, else 0.
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *ptr;
+
+    if (alignment % sizeof(void *) != 0 ||
+            (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if ((ptr = memalign(alignment, size)) == NULL && size != 0)
+        return ENOMEM;
+
+    *memptr = ptr;
+    return 0;
+}
+
+/*
+ * aligned_alloc - C11 memalign
+ */
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes each, their payloads
+ *                   in out[]. Returns how many were allocated (n unless
+ *                   out of memory). Small sizes first empty the thread
+ *                   cache bin. Heap blocks are cut out of as few free
+ *                   blocks as can be: the longest run of the rest that
+ *                   one free block holds (halving it until one does) is
+ *                   placed as a single block, then split. When no free
+ *                   block holds two, the heap grows once for the rest.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t bsize, k, done = 0;
+    tcache_t *tc;
+    arena_t *a;
+    char *ptr;
+
+    if (size == 0)
+        return 0;
+    if (size >= mmap_threshold) {
+        while (done < n && (out[done] = map_alloc(size, ALIGNMENT)) != NULL)
+            done++;
+        return done;
+    }
+
+    bsize = (ALIGN(size) <= SLAB_MAX) ? ALIGN(size) : ASIZE(size);
+    if (bsize <= TCACHE_MAX && (tc = tcache_get()) != NULL) {
+        int idx = TCACHE_IDX(bsize);
+        for (; done < n && (ptr = tc->bins[idx]) != NULL; done++) {
+            tc->bins[idx] = TCACHE_NEXT(ptr);
+            tc->count[idx]--;
+            tc->bytes -= bsize;
+            out[done] = ptr;
+        }
+    }
+    if (done == n || (a = arena_get()) == NULL)
+        return done;
+
+    pthread_mutex_lock(&a->lock);
+    remote_drain(a);
+    while (done < n) {
+        if (bsize <= SLAB_MAX) {
+            if ((out[done] = slab_alloc(a, bsize)) == NULL)
+                break;
+            done++;
+            continue;
+        }
+
+        /* Runs stay far from big block sizes */
+        k = MIN(n - done, BIG_MIN / 2 / bsize);
+        for (ptr = NULL; k > 1 && (ptr = find_fit(a, k * bsize)) == NULL; )
+            k /= 2;
+        if (ptr != NULL)
+            place(a, ptr, k * bsize);
+        else {
+            k = MIN(n - done, BIG_MIN / 2 / bsize);
+            while ((ptr = heap_alloc(a, k * bsize)) == NULL && k > 1)
+                k /= 2;
+            if (ptr == NULL)
+                break;
+        }
+        heap_split(ptr, bsize, k, out + done);
+        done += k;
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    return done;
+}
+
+/*
+ * mm_free_batch - Free the n blocks of ptrs[] (NULL ones skipped), which
+ *                 is sorted by address on the way. Blocks are freed under
+ *                 a single lock of the thread's arena, each run of heap
+ *                 neighbours merged into one block first, so it is
+ *                 coalesced (and counted by the decay clock) once. Huge
+ *                 blocks are unmapped, those of other arenas pushed on
+ *                 their remote lists, the thread cache is left alone.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    arena_t *a = (arena_epoch == heap_epoch) ? thread_arena : NULL;
+    size_t i, j, size;
+    char *ptr, *next;
+    int r;
+
+    if (a == NULL) {
+        for (i = 0; i < n; i++)
+            free(ptrs[i]);
+        return;
+    }
+
+    /* Blocks from mm_malloc_batch mostly come sorted already */
+    for (i = 1; i < n && ptrs[i - 1] <= ptrs[i]; i++)
+        ;
+    if (i < n)
+        qsort(ptrs, n, sizeof(void *), ptr_cmp);
+
+    pthread_mutex_lock(&a->lock);
+    for (i = 0; i < n; i = j) {
+        ptr = ptrs[i];
+        j = i + 1;
+        if (ptr == NULL)
+            continue;
+        if ((r = mem_region_of(ptr)) < 0)
+            mem_unmap(ptr - MAP_OFF(ptr), MAP_LEN(ptr));
+        else if (ARENA(r % NARENAS) != a)
+            remote_push(ARENA(r % NARENAS), ptr, ptr);
+        else if (r >= NARENAS)
+            slab_free(a, ptr);
+        else {
+            size = GET_SIZE(HDRP(ptr));
+            for (next = ptr + size; j < n && ptrs[j] == next &&
+                    size + GET_SIZE(HDRP(next)) < BIG_MIN / 2; j++) {
+                size += GET_SIZE(HDRP(next));
+                next += GET_SIZE(HDRP(next));
+            }
+            PUT(HDRP(ptr), PACK(size, GET_PREV_ALLOC(HDRP(ptr)) | 1));
+#ifdef ALLOC_FOOTERS
+            PUT(FTRP(ptr), PACK(size, 1));  /* Quick lists check it */
+#endif
+            heap_free(a, ptr);
+        }
+    }
+    pthread_mutex_unlock(&a->lock);
+}
+
 
 /*
  * Return whether the pointer is in the heap.
  * Useful in debugging.
  */
 static int in_heap(const void *p) {
-    return p <= mem_heap_hi() && p >= mem_heap_lo();
+    return mem_in_heap(p, p);
 }
 
 /*
@@ -260,32 +1051,59 @@ static int aligned(const void *p) {
     return (size_t)ALIGN(p) == (size_t)p;
 }
 
-/* 
- * mm_checkheap - 
+/*
+ * mm_checkheap -
  * Heap Checker first checks on a block by block basis for inconsistency
  * In this order
- * - Prologue block. 
+ * - Prologue block.
  * - Iterate through list till epilogue block
  *   On each block, call the checkblock function to check block.
  *   Count number of free blocks
- * 
+ *
  * Check ending epilogue block
  *
- * Then we check free list. 
+ * Then we check every class free list.
  * - Iterate over entire free list
- *    Check for Prev/Next Allocate consistency
+ *    Check for Prev/Next consistency
  *    All pointers are between heap
+ *    Block is free and belongs to this size class
+ * And the tree of large blocks (see tree_check)
  *
  * Compare Block free list count to actual free list count
+ * Then the dirty list, and the purged bytes of large free blocks
+ * Then the quick lists: allocated blocks of the bin size, bytes add up
+ *
+ * Last the slabs (see slab_check)
  *
+ * This is done for every arena, each under its own lock. Blocks sitting
+ * in thread caches are allocated as far as the arenas know.
  */
 void mm_checkheap(int lineno) {
+    int idx;
+
+    for (idx = 0; idx < NARENAS; idx++) {
+        if (!(arena_ready & (1UL << idx)))
+            continue;
+        pthread_mutex_lock(&ARENA(idx)->lock);
+        checkheap_locked(ARENA(idx), lineno);
+        pthread_mutex_unlock(&ARENA(idx)->lock);
+    }
+}
+
+/*
+ * checkheap_locked - mm_checkheap of one arena, with its lock held
+ */
+static void checkheap_locked(arena_t *a, int lineno) {
     void *ptr;
     int numfree1 = 0, numfree2 = 0;     /* Count free blocks */
-    ptr = heap_listp;                   /* Start from the first block address */
-
-    /* Check prologue */ 
-    if ((GET_SIZE(HDRP(ptr)) != MINIMUM) || (GET_ALLOC(HDRP(ptr)) != 1)) {
+    int numdirty1 = 0, numdirty2 = 0;   /* Count large free blocks not clean */
+    size_t purged = 0;                  /* Sum of their purged bytes */
+    size_t quick = 0;                   /* Bytes in the quick lists */
+    int i;
+    ptr = a->heap_listp;                /* Start from the prologue block */
+
+    /* Check prologue */
+    if ((GET_SIZE(HDRP(ptr)) != DSIZE) || (GET_ALLOC(HDRP(ptr)) != 1)) {
         printf("Addr: %p - ** Prologue Error** \n", ptr);
         assert(0);
     }
@@ -297,6 +1115,15 @@ void mm_checkheap(int lineno) {
 
         /* Perform all checks done on block */
         checkblock(ptr);
+        if (ARENA_OF(ptr) != a) {
+            printf("Addr: %p - ** Block Outside Arena** \n", ptr);
+            assert(0);
+        }
+        /* Next header must know whether this block is allocated */
+        if (!GET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr))) != !GET_ALLOC(HDRP(ptr))) {
+            printf("Addr: %p - ** Prev Alloc Bit Error** \n", ptr);
+            assert(0);
+        }
         /* Check coalescing: If alloc bit of current and next block is 0 */
         if (!(GET_ALLOC(HDRP(ptr)) || GET_ALLOC(HDRP(NEXT_BLKP(ptr))))) {
             printf("Addr: %p - ** Coalescing Error** \n", ptr);
@@ -306,210 +1133,1190 @@ void mm_checkheap(int lineno) {
         /* Count number of free blocks */
         if(!(GET_ALLOC(HDRP(ptr))))
             numfree1++;
+        if (!GET_ALLOC(HDRP(ptr)) && GET_SIZE(HDRP(ptr)) >= PURGE_MIN) {
+            purged += PURGED(ptr);
+            if (PURGE_STATE(ptr) != PURGE_CLEAN)
+                numdirty1++;
+            /* Known zero range inside the payload, its ends zero */
+            if (ZERO_LO(ptr) < ZERO_HI(ptr) &&
+                    (ZERO_LO(ptr) < (char *)ptr + PURGE_HDR ||
+                     ZERO_HI(ptr) > FTR_HI(FTRP(ptr)) ||
+                     *ZERO_LO(ptr) != 0 || *(ZERO_HI(ptr) - 1) != 0)) {
+                printf("Addr: %p - ** Zero Range Error** \n", ptr);
+                assert(0);
+            }
+        }
 
         ptr = NEXT_BLKP(ptr);
     }
 
-    /* Heap Check for explicit list */ 
-    ptr = free_listp;     
-
-    /* If our free list is empty, nothing to check */
-    if (ptr == 0) {
-        return;
-    }
-
-    /* Iterating through free list */ 
-    while (ptr != NULL) {
-        if (!freelistedge(ptr)) {
+    /* Heap Check for explicit lists */
+    for (i = 0; i < NUM_CLASSES; i++) {
+#ifndef REALTIME
+        /* Address ordered: the class is a tree */
+        if (a->policy == MM_PLACE_ADDRESS) {
+            numfree2 += tree_check(SEG_LIST(a, i), i, NULL, NULL);
+            continue;
+        }
+#endif
+        /* Iterating through class free list */
+        for (ptr = SEG_LIST(a, i); ptr != NULL; ptr = NEXT_FREEP(ptr)) {
             /* All next/prev pointers are consistent */
-            if (PREV_FREEP(NEXT_FREEP(ptr)) != NEXT_FREEP(PREV_FREEP(ptr))) {
+            if ((NEXT_FREEP(ptr) != NULL && PREV_FREEP(NEXT_FREEP(ptr)) != ptr) ||
+                    (PREV_FREEP(ptr) == NULL && SEG_LIST(a, i) != ptr)) {
                 printf("Addr: %p - ** Next/Prev Consistency Error ** \n", ptr);
                 assert(0);
             }
+            /* Free List bounds check */
+            if (!in_heap(ptr)) {
+                printf("Addr: %p - ** Free List Out of bounds** \n", ptr);
+                assert(0);
+            }
+            /* Only free blocks of the right class */
+            if (GET_ALLOC(HDRP(ptr)) || sizeclass(GET_SIZE(HDRP(ptr))) != i) {
+                printf("Addr: %p - ** Free List Class Error** \n", ptr);
+                assert(0);
+            }
+            numfree2++;
         }
-        /* Free List bounds check */ 
-        if (!in_heap(ptr)) {
-            printf("Addr: %p - ** Free List Out of bounds** \n", ptr);
+#ifdef REALTIME
+        /* Bitmaps flag exactly the non empty lists */
+        if (!(a->sl_bitmap[i / SL_COUNT] & (1U << (i % SL_COUNT))) !=
+                (SEG_LIST(a, i) == NULL) ||
+                !(a->fl_bitmap & (1U << (i / SL_COUNT))) !=
+                (a->sl_bitmap[i / SL_COUNT] == 0)) {
+            printf("Class: %d - ** Bitmap Error** \n", i);
             assert(0);
         }
-        numfree2++; 
-        ptr = NEXT_FREEP(ptr);
+#endif
     }
 
+#ifndef REALTIME
+    /* Then walk the tree of large blocks */
+    numfree2 += tree_check(a->tree_root, -1, NULL, NULL);
+#endif
+
     if (numfree1 != numfree2) {
         printf(" Error: - ** %d Free List Count %d ** \n", numfree1, numfree2);
         assert(0);
     }
+
+    /* Dirty list: large free blocks not clean, oldest first */
+    for (ptr = a->dirty; ptr != NULL; ptr = DIRTY_NEXT(ptr)) {
+        if (GET_ALLOC(HDRP(ptr)) || GET_SIZE(HDRP(ptr)) < PURGE_MIN ||
+                PURGE_STATE(ptr) == PURGE_CLEAN ||
+                (DIRTY_NEXT(ptr) != NULL && (DIRTY_PREV(DIRTY_NEXT(ptr)) != ptr ||
+                    PURGE_STAMP(DIRTY_NEXT(ptr)) < PURGE_STAMP(ptr))) ||
+                (DIRTY_NEXT(ptr) == NULL && a->dirty_tail != ptr)) {
+            printf("Addr: %p - ** Dirty List Error** \n", ptr);
+            assert(0);
+        }
+        numdirty2++;
+    }
+    if (numdirty1 != numdirty2 || purged != a->purged) {
+        printf(" Error: - ** %d Dirty List Count %d, %zu Purged %zu ** \n",
+                numdirty1, numdirty2, purged, a->purged);
+        assert(0);
+    }
+
+    /* Next fit rover: a free block of some class list */
+    if (a->rover != NULL && (GET_ALLOC(HDRP(a->rover)) ||
+#ifndef REALTIME
+            GET_SIZE(HDRP(a->rover)) >= TREE_MIN ||
+#endif
+            !in_heap(a->rover))) {
+        printf("Addr: %p - ** Rover Error** \n", a->rover);
+        assert(0);
+    }
+
+    /* Quick lists: allocated blocks of their bin's size */
+    for (i = 0; a->quick != NULL && i < QUICK_BINS; i++) {
+        for (ptr = a->quick[i]; ptr != NULL; ptr = QUICK_NEXT(ptr)) {
+            if (!in_heap(ptr) || !GET_ALLOC(HDRP(ptr)) ||
+                    GET_SIZE(HDRP(ptr)) != (size_t)(i + 1) * ALIGNMENT) {
+                printf("Addr: %p - ** Quick List Error** \n", ptr);
+                assert(0);
+            }
+            quick += GET_SIZE(HDRP(ptr));
+        }
+    }
+    if (quick != a->quick_bytes) {
+        printf(" Error: - ** %zu Quick List Bytes %zu ** \n",
+                quick, a->quick_bytes);
+        assert(0);
+    }
+
+    slab_check(a);
 }
 
 
 /********  The remaining routines are internal helper routines  **************/
 
-/* 
- * extend_heap - Extend heap with free block and return its block pointer
+/*
+ * arena_init - Build arena idx at the bottom of region idx.
+ * Arena (with the class heads) goes at the bottom of the heap, followed by
+ * the prologue and epilogue. Memory is then one huge block that is in a
+ * free list. Caller must hold arena_lock.
  */
-static void *extend_heap(size_t words) 
-{
-    char *ptr;
-    size_t size;
+static int arena_init(int idx) {
+    arena_t *a;
+    char *heap_listp;
+    int i;
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
-    if (size < MINIMUM)
-        size = MINIMUM;
-    if ((long)(ptr = mem_sbrk(size)) == -1)  
-        return NULL;                                        
+    /* Create the arena and its class list heads */
+    if ((a = mem_region_sbrk(idx, ALIGN(sizeof(arena_t)))) == (void *)-1)
+        return -1;
+    pthread_mutex_init(&a->lock, NULL);
+    a->region = idx;
+    a->remote = NULL;
+    for (i = 0; i < NUM_CLASSES; i++)
+        SEG_LIST(a, i) = NULL;
+    for (i = 0; i < SLAB_CLASSES; i++) {
+        a->slabs[i] = NULL;
+        a->slab_warm[i] = 0;
+    }
+    a->slab_empty = NULL;
+    a->dirty = a->dirty_tail = NULL;
+    a->tick = 0;
+    a->purged = 0;
+    a->quick = NULL;
+    a->quick_bytes = 0;
+    a->policy = placement;
+    a->rover = NULL;
+
+#ifdef REALTIME
+    for (i = 0; i < FL_COUNT; i++)
+        a->sl_bitmap[i] = 0;
+    a->fl_bitmap = 0;
+#else
+    a->tree_root = NULL;
+#endif
+
+    /* Create the initial empty heap */
+    if ((heap_listp = mem_region_sbrk(idx, 4*WSIZE)) == (void *)-1)
+        return -1;
+    PUT(heap_listp, 0);                            /* Alignment padding */
+    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1));   /* Prologue header */
+    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1));   /* Prologue footer */
+    PUT(heap_listp + (3*WSIZE), PACK(0, PREV_ALLOC | 1)); /* Epilogue header */
+    a->heap_listp = heap_listp + DSIZE;
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(ptr), PACK(size, 0));         /* Free block header */   
-    PUT(FTRP(ptr), PACK(size, 0));         /* Free block footer */   
-    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 1)); /* New epilogue header */ 
+    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
+    if (extend_heap(a, CHUNKSIZE/WSIZE) == NULL)
+        return -1;
 
-    /* Coalesce if the previous block was free */
-    return coalesce(ptr);                                          
+    return 0;
 }
 
 /*
- * coalesce - Boundary tag coalescing. Returns ptr to coalesced block
- * Function: Coalesce newly freed block with neighbours, if no neighbour
- * is free, just append new free block to list. 
- *
- * To coalesce newly freed block with neighbours, these are the possibilities
- *    [PREV -  CURR - NEXT ]
- *      ||      ||     ||
- *      ||      ||     ||
- * 1: [ALLOC - FREE - ALLOC  ] Result: Just append new block to list
- * 2: [FREE  - FREE - ALLOC  ] Result: Append new block (PREV + CURR)
- * 3: [ALLOC - FREE - FREE   ] Result: Append new block (CURR + NEXT)
- * 4: [FREE  - FREE - FREE   ] Result: Apppend new block (PREV  + CURR + NEXT)
+ * arena_get - Returns the arena of the calling thread, NULL if none.
+ *             First call in a thread (or after mm_init) picks the arena
+ *             of the thread's cpu (or the next one, round robin) and
+ *             builds it if no other thread did yet.
  */
-static void *coalesce (void *ptr) 
-{
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(ptr)));
-    /* When at front, prev block is same as curr block :( Nasty bug it was */
-    if (PREV_BLKP(ptr) == ptr )
-        prev_alloc = 1;
+static arena_t *arena_get(void) {
+    int idx = -1;
 
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
-    size_t size = GET_SIZE(HDRP(ptr));
+    if (thread_arena != NULL && arena_epoch == heap_epoch)
+        return thread_arena;
 
-    /* Case  1 constructed as fall through scenario */ 
+#ifndef ARENA_ROUND_ROBIN
+    idx = sched_getcpu();
+#endif
 
-    if (prev_alloc && !next_alloc) {      /* Case 2 */
-        size += GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        removefreeblock(NEXT_BLKP(ptr));           /* remove next block */        
-        PUT(HDRP(ptr), PACK(size, 0));
-        PUT(FTRP(ptr), PACK(size,0));
+    pthread_mutex_lock(&arena_lock);
+    idx = (idx < 0) ? (int)(arena_next++ % NARENAS) : idx % NARENAS;
+    if (!(arena_ready & (1UL << idx))) {
+        if (arena_init(idx) < 0) {
+            pthread_mutex_unlock(&arena_lock);
+            return NULL;
+        }
+        arena_ready |= 1UL << idx;
     }
+    pthread_mutex_unlock(&arena_lock);
 
-    else if (!prev_alloc && next_alloc) {      /* Case 3 */
-        size += GET_SIZE(HDRP(PREV_BLKP(ptr)));
-        removefreeblock(PREV_BLKP(ptr));          /* remove previous block */
-        PUT(FTRP(ptr), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 0));
-        ptr = PREV_BLKP(ptr);
+    thread_arena = ARENA(idx);
+    arena_epoch = heap_epoch;
+    return thread_arena;
+}
+
+/*
+ * heap_alloc - Allocate a block of asize bytes from arena a: the head of
+ *              its quick list if any, else a fit from the free lists,
+ *              merging the quick lists first if there is none.
+ *              Arena lock must be held.
+ */
+static void *heap_alloc(arena_t *a, size_t asize) {
+    size_t extendsize; /* Amount to extend heap if no fit */
+    char *ptr;
+
+    /* Quick list blocks are still allocated, and of the exact size */
+    if (asize <= quick_max && a->quick != NULL &&
+            (ptr = a->quick[QUICK_IDX(asize)]) != NULL) {
+        a->quick[QUICK_IDX(asize)] = QUICK_NEXT(ptr);
+        a->quick_bytes -= asize;
+        a->zero_lo = a->zero_hi = NULL;
+        return ptr;
     }
 
-    else if (!prev_alloc && !next_alloc){      /* Case 4 */
-        size += GET_SIZE(HDRP(PREV_BLKP(ptr))) + 
-            GET_SIZE(FTRP(NEXT_BLKP(ptr)));
-        removefreeblock(NEXT_BLKP(ptr));           /* remove next block */        
-        removefreeblock(PREV_BLKP(ptr));         /* remove previous block */
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(ptr)), PACK(size, 0));
-        ptr = PREV_BLKP(ptr);
+    /* Search the free lists for a fit */
+    ptr = find_fit(a, asize);
+    if (ptr == NULL && a->quick_bytes != 0) {
+        quick_merge(a);
+        ptr = find_fit(a, asize);
+    }
+    if (ptr == NULL && tcache_reclaim(a))
+        ptr = find_fit(a, asize);
+    if (ptr != NULL) {
+        place(a, ptr, asize);
+        return ptr;
+    }
+
+    /* No fit found. Get more memory and place the block */
+    extendsize = MAX(asize,CHUNKSIZE);
+    if ((ptr = extend_heap(a, extendsize/WSIZE)) == NULL)
+        return NULL;
+    place(a, ptr, asize);
+    return ptr;
+}
+
+/*
+ * tcache_reclaim - Free and coalesce the blocks of arena a in the cache of
+ *                  the calling thread, which would rather not grow the
+ *                  heap while they sit idle. Returns the number freed.
+ *                  Arena lock must be held.
+ */
+static int tcache_reclaim(arena_t *a) {
+    tcache_t *tc = tcache;
+    char *ptr, **link;
+    int idx, n = 0;
+
+    if (tc == NULL || tcache_epoch != heap_epoch)
+        return 0;
+    for (idx = 0; idx < TCACHE_BINS; idx++) {
+        for (link = &tc->bins[idx]; (ptr = *link) != NULL; ) {
+            if (ARENA_OF(ptr) != a) {
+                link = &TCACHE_NEXT(ptr);
+                continue;
+            }
+            *link = TCACHE_NEXT(ptr);
+            tc->count[idx]--;
+            tc->bytes -= TCACHE_SIZE(idx);
+            if (IN_SLAB(ptr))
+                slab_free(a, ptr);
+            else
+                heap_release(a, ptr);
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * heap_split - Cut the allocated block ptr into k blocks of bsize bytes,
+ *              the last one keeping any bytes over, and put their
+ *              payloads in out[]. Arena lock must be held.
+ */
+static void heap_split(char *ptr, size_t bsize, size_t k, void **out) {
+    size_t last = GET_SIZE(HDRP(ptr)) - (k - 1) * bsize;
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+    size_t i;
+
+    for (i = 0; i < k; i++) {
+        out[i] = ptr;
+        PUT(HDRP(ptr), PACK((i < k - 1) ? bsize : last, prev_alloc | 1));
+#ifdef ALLOC_FOOTERS
+        PUT(FTRP(ptr), PACK(GET_SIZE(HDRP(ptr)), 1));
+#endif
+        prev_alloc = PREV_ALLOC;
+        ptr = NEXT_BLKP(ptr);
+    }
+}
+
+/*
+ * ptr_cmp - qsort order of block pointers: by address
+ */
+static int ptr_cmp(const void *x, const void *y) {
+    char *p = *(char * const *)x, *q = *(char * const *)y;
+
+    return (p > q) - (p < q);
+}
+
+/*
+ * heap_free - Free a block (or slab slot) back to arena a, which owns it.
+ *             Blocks of up to quick_max bytes go on a quick list, merged
+ *             once the lists hold QUICK_BYTES. Arena lock must be held.
+ */
+static void heap_free(arena_t *a, void *ptr) {
+    size_t size;
+
+    if (IN_SLAB(ptr)) {
+        slab_free(a, ptr);
+        return;
+    }
+
+    size = GET_SIZE(HDRP(ptr));
+    if (size <= quick_max && (a->quick != NULL || quick_init(a) == 0)) {
+        QUICK_NEXT(ptr) = a->quick[QUICK_IDX(size)];
+        a->quick[QUICK_IDX(size)] = ptr;
+        if ((a->quick_bytes += size) >= QUICK_BYTES)
+            quick_merge(a);
+        return;
+    }
+
+    heap_release(a, ptr);
+}
+
+/*
+ * heap_release - Free heap block ptr of arena a and coalesce it, then
+ *                trim and purge. Arena lock must be held.
+ */
+static void heap_release(arena_t *a, void *ptr) {
+    size_t size = GET_SIZE(HDRP(ptr));
+
+    /* Set header, footer alloc bits to zero, tell the next block */
+    setfreeblock(ptr, size, GET_PREV_ALLOC(HDRP(ptr)));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+
+    /* A free block at the top of twice the threshold goes back to the
+     * system, but for threshold bytes: a heap going up and down around
+     * its top does not grow and shrink every time */
+    ptr = coalesce(a, ptr, 0);
+    if (GET_SIZE(HDRP(ptr)) >= 2 * trim_threshold &&
+            GET_SIZE(HDRP(NEXT_BLKP(ptr))) == 0)
+        arena_trim(a, trim_threshold);
+
+    a->tick++;
+    arena_purge(a, 0);
+}
+
+/*
+ * quick_init - Allocate the quick list heads of arena a from its heap.
+ *              Returns -1 if out of memory. Arena lock must be held.
+ */
+static int quick_init(arena_t *a) {
+    int i;
+
+    if ((a->quick = heap_alloc(a, ASIZE(QUICK_BINS * sizeof(char *)))) == NULL)
+        return -1;
+    for (i = 0; i < QUICK_BINS; i++)
+        a->quick[i] = NULL;
+    return 0;
+}
+
+/*
+ * quick_merge - Free and coalesce every block on the quick lists of
+ *               arena a. Arena lock must be held.
+ */
+static void quick_merge(arena_t *a) {
+    char *ptr;
+    int i;
+
+    for (i = 0; i < QUICK_BINS && a->quick_bytes != 0; i++) {
+        while ((ptr = a->quick[i]) != NULL) {
+            a->quick[i] = QUICK_NEXT(ptr);
+            a->quick_bytes -= GET_SIZE(HDRP(ptr));
+            heap_release(a, ptr);
+        }
+    }
+}
+
+/*
+ * heap_realloc - Resize the allocated block ptr of arena a to asize bytes
+ *                in place. Returns ptr, or NULL if it has to move.
+ *                Shrinking splits off the tail (if big enough to be a
+ *                block). Growing absorbs the next block if free and big
+ *                enough; at the top of the heap, the heap is extended
+ *                first by what is missing. Arena lock must be held.
+ */
+static void *heap_realloc(arena_t *a, void *ptr, size_t asize) {
+    size_t csize = GET_SIZE(HDRP(ptr));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+    char *next = NEXT_BLKP(ptr);
+    size_t avail = csize + (GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next)));
+
+    /* Last block of the heap (but for a free one): grow the heap */
+    if (asize > avail && (GET_SIZE(HDRP(next)) == 0 ||
+            (!GET_ALLOC(HDRP(next)) && GET_SIZE(HDRP(NEXT_BLKP(next))) == 0))) {
+        if (extend_heap(a, (asize - avail) / WSIZE) == NULL)
+            return NULL;
+        next = NEXT_BLKP(ptr);
+    }
+
+    /* Absorb the free next block */
+    if (asize > csize && !GET_ALLOC(HDRP(next)) &&
+            csize + GET_SIZE(HDRP(next)) >= asize) {
+        removefreeblock(a, next);
+        csize += GET_SIZE(HDRP(next));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(next)));
+    }
+    if (asize > csize)
+        return NULL;
+
+    /* Split off the tail, then free it at once (no quick list) */
+    if (csize - asize >= MINIMUM) {
+        PUT(HDRP(ptr), PACK(asize, prev_alloc | 1));
+        next = NEXT_BLKP(ptr);
+        /* The tail may be big: write it like a free block, then mark it
+         * allocated for heap_release */
+        setfreeblock(next, csize - asize, PREV_ALLOC);
+        PUT(HDRP(next), GET(HDRP(next)) | 1);
+        heap_release(a, next);
+    }
+    else
+        PUT(HDRP(ptr), PACK(csize, prev_alloc | 1));
+#ifdef ALLOC_FOOTERS
+    PUT(FTRP(ptr), PACK(GET_SIZE(HDRP(ptr)), 1));
+#endif
+
+    return ptr;
+}
+
+/*
+ * heap_memalign - Allocate a block of asize bytes from arena a whose
+ *                 payload is aligned to align. Takes a block with room for
+ *                 align more bytes and a minimum block before the payload,
+ *                 frees the leading fragment, then gives the tail back
+ *                 with heap_realloc. Arena lock must be held.
+ */
+static void *heap_memalign(arena_t *a, size_t align, size_t asize) {
+    char *ptr, *aligned;
+    size_t csize, lead;
+
+    if ((ptr = heap_alloc(a, asize + align + MINIMUM)) == NULL)
+        return NULL;
+
+    aligned = (char *)(((size_t)ptr + align - 1) & ~(align - 1));
+    if (aligned != ptr) {
+        /* The leading fragment must be a block */
+        while ((size_t)(aligned - ptr) < MINIMUM)
+            aligned += align;
+        csize = GET_SIZE(HDRP(ptr));
+        lead = aligned - ptr;
+        PUT(HDRP(ptr), PACK(lead, GET_PREV_ALLOC(HDRP(ptr)) | 1));
+        PUT(HDRP(aligned), PACK(csize - lead, PREV_ALLOC | 1));
+        heap_release(a, ptr);
+    }
+
+    return heap_realloc(a, aligned, asize);
+}
+
+/*
+ * arena_trim - Shrink the heap of arena a by its free top block, but for
+ *              pad bytes of it (at least MINIMUM if any). On huge pages
+ *              the top stays on a huge page boundary, keeping more.
+ *              Returns 1 if the heap shrank. Arena lock must be held.
+ */
+static int arena_trim(arena_t *a, size_t pad) {
+    char *epi = (char *)mem_region_hi(a->region) + 1; /* Past epilogue hdr */
+    char *last, *zlo = NULL, *zhi = NULL;
+    size_t size, keep, purged, top, hp = mem_hugepagesize();
+
+    /* Nothing to do unless the block before the epilogue is free */
+    if (GET_PREV_ALLOC(HDRP(epi)))
+        return 0;
+    last = PREV_BLKP(epi);
+    size = GET_SIZE(HDRP(last));
+    keep = (pad == 0) ? 0 : MAX(ALIGN(pad), MINIMUM);
+    if (hp != 0) {
+        /* Cut whole huge pages only, leaving room for a block if any */
+        top = (size_t)(epi - size + keep);
+        keep += ((top + hp - 1) & ~(hp - 1)) - top;
+        if (keep != 0 && keep < MINIMUM)
+            keep += hp;
+    }
+    if (keep >= size)
+        return 0;
+
+    purged = PURGED_OF(last);
+    zero_of(last, &zlo, &zhi);
+    removefreeblock(a, last);
+    if (keep == 0) {
+        /* The free block header becomes the epilogue */
+        PUT(HDRP(last), PACK(0, GET_PREV_ALLOC(HDRP(last)) | 1));
+    }
+    else {
+        setfreeblock(last, keep, GET_PREV_ALLOC(HDRP(last)));
+        PUT(HDRP(NEXT_BLKP(last)), PACK(0, 1));
+        if (keep >= PURGE_MIN) {
+            PURGED(last) = (purged < keep) ? purged : keep;
+            ZERO_LO(last) = ZERO_HI(last) = NULL;
+            zero_add(last, zlo, zhi);
+        }
+        insertfreeblock(a, last);
+    }
+    mem_region_sbrk(a->region, -(intptr_t)(size - keep));
+
+    return 1;
+}
+
+/*
+ * arena_purge - Purge the blocks at the front of the dirty list of arena
+ *               a that decayed: dirty ones lazily, muzzy ones for good.
+ *               With all set, drop every block on the list for good.
+ *               Returns 1 if any block was purged. Arena lock must be held.
+ */
+static int arena_purge(arena_t *a, int all) {
+    size_t page = mem_hugepagesize() ? mem_hugepagesize() : mem_pagesize();
+    char *ptr, *lo, *hi;
+    int done = 0;
+
+    while ((ptr = a->dirty) != NULL &&
+            (all || a->tick - PURGE_STAMP(ptr) >= purge_decay)) {
+        dirty_unlink(a, ptr);
+        /* Whole (huge) pages between the purge fields and the footer */
+        lo = (char *)(((size_t)ptr + PURGE_HDR + page - 1) & ~(page - 1));
+        hi = (char *)((size_t)FTR_HI(FTRP(ptr)) & ~(page - 1));
+        if (hi > lo)
+            mem_decommit(lo, hi - lo, !all && PURGE_STATE(ptr) == PURGE_DIRTY);
+
+        if (!all && PURGE_STATE(ptr) == PURGE_DIRTY) {
+            PURGE_STATE(ptr) = PURGE_MUZZY;
+            PURGE_STAMP(ptr) = a->tick;
+            dirty_link(a, ptr);
+        }
+        else {
+            PURGE_STATE(ptr) = PURGE_CLEAN;
+            a->purged += (size_t)(hi - lo) - PURGED(ptr);
+            PURGED(ptr) = hi - lo;
+            zero_add(ptr, lo, hi);
+        }
+        done = 1;
+    }
+    return done;
+}
+
+/*
+ * dirty_link - Append large free block ptr to the dirty list of arena a
+ */
+static void dirty_link(arena_t *a, char *ptr) {
+    DIRTY_PREV(ptr) = a->dirty_tail;
+    DIRTY_NEXT(ptr) = NULL;
+    if (a->dirty_tail != NULL)
+        DIRTY_NEXT(a->dirty_tail) = ptr;
+    else
+        a->dirty = ptr;
+    a->dirty_tail = ptr;
+}
+
+/*
+ * dirty_unlink - Remove large free block ptr from the dirty list of arena a
+ */
+static void dirty_unlink(arena_t *a, char *ptr) {
+    if (DIRTY_PREV(ptr) != NULL)
+        DIRTY_NEXT(DIRTY_PREV(ptr)) = DIRTY_NEXT(ptr);
+    else
+        a->dirty = DIRTY_NEXT(ptr);
+    if (DIRTY_NEXT(ptr) != NULL)
+        DIRTY_PREV(DIRTY_NEXT(ptr)) = DIRTY_PREV(ptr);
+    else
+        a->dirty_tail = DIRTY_PREV(ptr);
+}
+
+/*
+ * tcache_get - Returns the cache of the calling thread, NULL if none.
+ *              First call in a thread (or after mm_init) allocates it
+ *              from the thread's arena.
+ */
+static tcache_t *tcache_get(void) {
+    tcache_t *tc;
+    arena_t *a;
+
+    if (tcache != NULL && tcache_epoch == heap_epoch)
+        return tcache;
+
+    pthread_once(&tcache_once, tcache_keyinit);
+
+    if ((a = arena_get()) == NULL)
+        return NULL;
+    pthread_mutex_lock(&a->lock);
+    tc = heap_alloc(a, ASIZE(sizeof(tcache_t)));
+    pthread_mutex_unlock(&a->lock);
+    if (tc == NULL)
+        return NULL;
+
+    memset(tc, 0, sizeof(tcache_t));
+    tcache = tc;
+    tcache_epoch = heap_epoch;
+    pthread_setspecific(tcache_key, tc);
+
+    return tc;
+}
+
+/*
+ * tcache_flush - Hand n blocks of bin idx back to the arenas owning them.
+ *                Blocks of the thread's arena are freed under its lock,
+ *                taken once for the batch. Each run of blocks of another
+ *                arena is chained and pushed on its remote list at once.
+ */
+static void tcache_flush(tcache_t *tc, int idx, unsigned int n) {
+    char *ptr, *first = NULL, *last = NULL;
+    arena_t *own = arena_get(), *ra = NULL;
+    int locked = 0;
+
+    while (n-- > 0 && (ptr = tc->bins[idx]) != NULL) {
+        tc->bins[idx] = TCACHE_NEXT(ptr);
+        tc->count[idx]--;
+        tc->bytes -= TCACHE_SIZE(idx);
+        if (ARENA_OF(ptr) == own) {
+            if (!locked) {
+                pthread_mutex_lock(&own->lock);
+                locked = 1;
+            }
+            heap_free(own, ptr);
+            continue;
+        }
+        if (ARENA_OF(ptr) != ra) {
+            if (first != NULL)
+                remote_push(ra, first, last);
+            ra = ARENA_OF(ptr);
+            first = NULL;
+        }
+        REMOTE_NEXT(ptr) = first;
+        if (first == NULL)
+            last = ptr;
+        first = ptr;
+    }
+    if (first != NULL)
+        remote_push(ra, first, last);
+    if (locked)
+        pthread_mutex_unlock(&own->lock);
+}
+
+/*
+ * tcache_destroy - Thread exit: give cached blocks and the cache itself
+ *                  back to their arenas, unless the heap was rebuilt since.
+ */
+static void tcache_destroy(void *arg) {
+    tcache_t *tc = arg;
+    arena_t *a;
+    int idx;
+
+    if (tc != tcache || tcache_epoch != heap_epoch)
+        return;
+
+    for (idx = 0; idx < TCACHE_BINS; idx++)
+        tcache_flush(tc, idx, tc->count[idx]);
+
+    a = ARENA_OF(tc);
+    pthread_mutex_lock(&a->lock);
+    heap_free(a, tc);
+    pthread_mutex_unlock(&a->lock);
+    tcache = NULL;
+}
+
+/*
+ * tcache_keyinit - Creates the key whose destructor flushes thread caches
+ */
+static void tcache_keyinit(void) {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * remote_push - Push the chain first..last of blocks owned by arena a on
+ *               its remote free list. Lock free: any thread may push
+ *               while the owner drains.
+ */
+static void remote_push(arena_t *a, char *first, char *last) {
+    char *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+    do {
+        REMOTE_NEXT(last) = head;
+    } while (!__atomic_compare_exchange_n(&a->remote, &head, first, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * remote_drain - Free every block other threads pushed on the remote
+ *                list of arena a. Arena lock must be held.
+ */
+static void remote_drain(arena_t *a) {
+    char *ptr, *next;
+
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL)
+        return;
+
+    ptr = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE);
+    while (ptr != NULL) {
+        next = REMOTE_NEXT(ptr);
+        heap_free(a, ptr);
+        ptr = next;
+    }
+}
+
+/*
+ * usable_size - Payload bytes of the block (or slab slot) at ptr
+ */
+static size_t usable_size(void *ptr) {
+    if (IS_MAPPED(ptr))
+        return MAP_LEN(ptr) - MAP_OFF(ptr);
+    if (IN_SLAB(ptr))
+        return SLAB_OF(ptr)->size;
+    return GET_SIZE(HDRP(ptr)) - OVERHEAD;
+}
+
+/*
+ * map_alloc - Give a huge block of size bytes a mapping of its own, its
+ *             payload aligned to align (a power of two). The payload
+ *             offset is at most MAX(align, MAP_HDR), mappings being page
+ *             aligned.
+ */
+static void *map_alloc(size_t size, size_t align) {
+    size_t off = MAX(align, MAP_HDR);
+    size_t len = (size + off + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    char *m, *ptr;
+
+    if (len < size || (m = mem_map(len)) == NULL)
+        return NULL;
+    ptr = (char *)(((size_t)m + MAP_HDR + align - 1) & ~(align - 1));
+    MAP_LEN(ptr) = len;
+    MAP_OFF(ptr) = ptr - m;
+    return ptr;
+}
+
+/*
+ * map_realloc - Resize the mapping of huge block ptr for size bytes.
+ *               The kernel moves the pages if it has to, no data is
+ *               copied. The payload keeps its offset, so an alignment
+ *               over a page may be lost. Returns the block, NULL (ptr
+ *               untouched) on failure.
+ */
+static void *map_realloc(void *ptr, size_t size) {
+    size_t off = MAP_OFF(ptr);
+    size_t len = (size + off + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    char *m;
+
+    if (len == MAP_LEN(ptr))
+        return ptr;
+    if (len < size ||
+        (m = mem_remap((char *)ptr - off, MAP_LEN(ptr), len)) == NULL)
+        return NULL;
+    MAP_LEN(m + off) = len;
+    return m + off;
+}
+
+/*
+ * slab_alloc - Take a slot of psize bytes from the first slab of its
+ *              class with room, set up a new slab if there is none.
+ *              The first SLAB_WARM requests of a class that would need
+ *              a new slab get a heap block instead, so a few tiny blocks
+ *              do not cost a whole slab. Arena lock must be held.
+ */
+static void *slab_alloc(arena_t *a, size_t psize) {
+    slab_t *s = a->slabs[SLAB_IDX(psize)];
+    int i, bit, n;
+
+    if (s == NULL) {
+        /* Reuse an empty slab, or get a new one at the top of the region */
+        if ((s = a->slab_empty) != NULL)
+            a->slab_empty = s->next;
+        else if (a->slab_warm[SLAB_IDX(psize)] < SLAB_WARM) {
+            a->slab_warm[SLAB_IDX(psize)]++;
+            return heap_alloc(a, ASIZE(SLAB_MAX + 1));
+        }
+        else if ((s = mem_region_sbrk(SLAB_REGION(a), SLAB_SIZE)) == (void *)-1)
+            return NULL;
+
+        s->size = psize;
+        s->used = 0;
+        s->nslots = (SLAB_SIZE - SLAB_FIRST) / psize;
+        /* Bits past the last slot stay set, so they never look free */
+        for (i = 0; i < SLAB_WORDS; i++) {
+            n = (int)s->nslots - 64 * i;
+            s->map[i] = (n >= 64) ? 0 : (n <= 0) ? ~0UL : ~0UL << n;
+        }
+        slab_link(a, s);
+    }
+
+    /* First free slot */
+    for (i = 0; s->map[i] == ~0UL; i++)
+        ;
+    bit = __builtin_ctzl(~s->map[i]);
+    s->map[i] |= 1UL << bit;
+
+    /* Full slabs leave the class list */
+    if (++s->used == s->nslots)
+        slab_unlink(a, s);
+
+    return (char *)s + SLAB_FIRST + (size_t)(64 * i + bit) * psize;
+}
+
+/*
+ * slab_free - Give the slot at ptr back to its slab. A slab that was
+ *             full goes back in its class list; one that becomes empty
+ *             goes to the empty slabs, unless it is the last slab of its
+ *             class (keeps a malloc/free pair from trashing slabs).
+ *             Arena lock must be held.
+ */
+static void slab_free(arena_t *a, void *ptr) {
+    slab_t *s = SLAB_OF(ptr);
+    size_t slot = ((char *)ptr - (char *)s - SLAB_FIRST) / s->size;
+
+    s->map[slot / 64] &= ~(1UL << (slot % 64));
+
+    if (s->used-- == s->nslots)
+        slab_link(a, s);
+
+    if (s->used == 0 && (a->slabs[SLAB_IDX(s->size)] != s || s->next != NULL)) {
+        slab_unlink(a, s);
+        s->size = 0;
+        s->next = a->slab_empty;
+        a->slab_empty = s;
+    }
+}
+
+/*
+ * slab_link - Push slab s on the list of its class
+ */
+static void slab_link(arena_t *a, slab_t *s) {
+    slab_t **head = &a->slabs[SLAB_IDX(s->size)];
+
+    s->prev = NULL;
+    s->next = *head;
+    if (*head != NULL)
+        (*head)->prev = s;
+    *head = s;
+}
+
+/*
+ * slab_unlink - Remove slab s from the list of its class
+ */
+static void slab_unlink(arena_t *a, slab_t *s) {
+    if (s->prev != NULL)
+        s->prev->next = s->next;
+    else
+        a->slabs[SLAB_IDX(s->size)] = s->next;
+    if (s->next != NULL)
+        s->next->prev = s->prev;
+}
+
+/*
+ * extend_heap - Extend heap with free block and return its block pointer
+ *               On huge pages, the heap grows up to the next huge page
+ *               boundary, so its top page is never half used.
+ */
+static void *extend_heap(arena_t *a, size_t words)
+{
+    char *ptr, *lo, *zero = mem_region_zero(a->region);
+    size_t size, hp = mem_hugepagesize();
+
+    /* Allocate a multiple of ALIGNMENT to maintain alignment */
+    size = ALIGN(words * WSIZE);
+    if (size < MINIMUM)
+        size = MINIMUM;
+    if (hp != 0) {
+        ptr = (char *)mem_region_hi(a->region) + 1;
+        size = (((size_t)ptr + size + hp - 1) & ~(hp - 1)) - (size_t)ptr;
     }
+    if ((long)(ptr = mem_region_sbrk(a->region, size)) == -1)
+        return NULL;
 
+    /* Initialize free block header/footer and the epilogue header.
+     * The old epilogue header knows whether the block before is free. */
+    setfreeblock(ptr, size, GET_PREV_ALLOC(HDRP(ptr))); /* Header, footer */
+    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 1)); /* New epilogue header */
 
-    /* Insert Coalesced block in free list */
-    insertfreeblock(ptr);       
+    /* Coalesce if the previous block was free. What the heap grew into
+     * past the zero mark of its region was never written */
+    lo = MAX(ptr, zero);
+    ptr = coalesce(a, ptr, 0);
+    zero_add(ptr, lo, lo + size);
 
     return ptr;
 }
 
-/* 
- * place - Place block of asize bytes at start of free block ptr 
- *         Remove free block. 
- *         if remainder < minimum block size, split it up and append it as a 
- *         free block by calling coalesce function. 
+/*
+ * coalesce - Boundary tag coalescing. Returns ptr to coalesced block
+ * Function: Coalesce newly freed block with neighbours, if no neighbour
+ * is free, just append new free block to list.
  *
+ * To coalesce newly freed block with neighbours, these are the possibilities
+ *    [PREV -  CURR - NEXT ]
+ *      ||      ||     ||
+ *      ||      ||     ||
+ * 1: [ALLOC - FREE - ALLOC  ] Result: Just append new block to list
+ * 2: [FREE  - FREE - ALLOC  ] Result: Append new block (PREV + CURR)
+ * 3: [ALLOC - FREE - FREE   ] Result: Append new block (CURR + NEXT)
+ * 4: [FREE  - FREE - FREE   ] Result: Apppend new block (PREV  + CURR + NEXT)
+ *
+ * Whether PREV is free comes from the prev allocated bit of CURR, since
+ * an allocated PREV has no footer. The merged block keeps the bit of its
+ * first block.
+ * CURR has purged bytes already dropped (see arena_purge), the merged
+ * block those of its parts. It keeps the largest known zero range of
+ * PREV and NEXT (CURR was just in use).
  */
-static void place(void *ptr, size_t asize)
+static void *coalesce(arena_t *a, void *ptr, size_t purged)
 {
-    size_t csize = GET_SIZE(HDRP(ptr));   
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
+    size_t size = GET_SIZE(HDRP(ptr));
+    char *zlo = NULL, *zhi = NULL;
 
+    if (!prev_alloc) {
+        purged += PURGED_OF(PREV_BLKP(ptr));
+        zero_of(PREV_BLKP(ptr), &zlo, &zhi);
+    }
+    if (!next_alloc) {
+        purged += PURGED_OF(NEXT_BLKP(ptr));
+        zero_of(NEXT_BLKP(ptr), &zlo, &zhi);
+    }
+
+    /* Case  1 constructed as fall through scenario */
+
+    if (prev_alloc && !next_alloc) {      /* Case 2 */
+        size += GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+        removefreeblock(a, NEXT_BLKP(ptr));           /* remove next block */
+        setfreeblock(ptr, size, GET_PREV_ALLOC(HDRP(ptr)));
+    }
+
+    else if (!prev_alloc && next_alloc) {      /* Case 3 */
+        size += GET_SIZE(HDRP(PREV_BLKP(ptr)));
+        removefreeblock(a, PREV_BLKP(ptr));          /* remove previous block */
+        ptr = PREV_BLKP(ptr);
+        setfreeblock(ptr, size, GET_PREV_ALLOC(HDRP(ptr)));
+    }
+
+    else if (!prev_alloc && !next_alloc){      /* Case 4 */
+        size += GET_SIZE(HDRP(PREV_BLKP(ptr))) +
+            GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+        removefreeblock(a, NEXT_BLKP(ptr));           /* remove next block */
+        removefreeblock(a, PREV_BLKP(ptr));         /* remove previous block */
+        ptr = PREV_BLKP(ptr);
+        setfreeblock(ptr, size, GET_PREV_ALLOC(HDRP(ptr)));
+    }
 
-    if ((csize - asize) >= (MINIMUM)) { 
-        PUT(HDRP(ptr), PACK(asize, 1));
+
+    /* Insert Coalesced block in its class free list */
+    if (size >= PURGE_MIN) {
+        PURGED(ptr) = purged;
+        ZERO_LO(ptr) = ZERO_HI(ptr) = NULL;
+        zero_add(ptr, zlo, zhi);
+    }
+    insertfreeblock(a, ptr);
+
+    return ptr;
+}
+
+/*
+ * place - Place block of asize bytes at start of free block ptr
+ *         Remove free block (before its header changes, as the size
+ *         decides which class list it is on).
+ *         if remainder >= minimum block size, split it up and append it as a
+ *         free block by calling coalesce function. It keeps as many of
+ *         the purged bytes as fit, and what is left of the known zero
+ *         range. The part of that range in the payload is left in the
+ *         arena for calloc.
+ *
+ */
+static void place(arena_t *a, void *ptr, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(ptr));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
+    size_t purged = PURGED_OF(ptr);
+    char *zlo = NULL, *zhi = NULL;
+
+    zero_of(ptr, &zlo, &zhi);
+    removefreeblock(a, ptr);
+    a->zero_lo = zlo;
+    a->zero_hi = MIN(zhi, (char *)ptr + asize - OVERHEAD);
+
+    if ((csize - asize) >= (MINIMUM)) {
+        PUT(HDRP(ptr), PACK(asize, prev_alloc | 1));
+#ifdef ALLOC_FOOTERS
         PUT(FTRP(ptr), PACK(asize, 1));
-        removefreeblock(ptr);
+#endif
         ptr = NEXT_BLKP(ptr);
-        PUT(HDRP(ptr), PACK(csize-asize, 0));
-        PUT(FTRP(ptr), PACK(csize-asize, 0));
-        coalesce(ptr);
+        setfreeblock(ptr, csize-asize, PREV_ALLOC);
+        ptr = coalesce(a, ptr, (purged < csize - asize) ? purged : csize - asize);
+        zero_add(ptr, zlo, zhi);
     }
-    else { 
-        PUT(HDRP(ptr), PACK(csize, 1));
+    else {
+        PUT(HDRP(ptr), PACK(csize, prev_alloc | 1));
+#ifdef ALLOC_FOOTERS
         PUT(FTRP(ptr), PACK(csize, 1));
-        removefreeblock(ptr);
+#endif
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
     }
 
 }
 
-/* 
+/*
+ * zero_merge - Widen the known zero range [*lo, *hi) with [zlo, zhi):
+ *              to their union if they touch, else to the larger one
+ */
+static void zero_merge(char **lo, char **hi, char *zlo, char *zhi)
+{
+    if (zlo >= zhi)
+        return;
+    if (*lo < *hi && zlo <= *hi && *lo <= zhi) {
+        *lo = MIN(*lo, zlo);
+        *hi = MAX(*hi, zhi);
+    }
+    else if (*lo >= *hi || zhi - zlo > *hi - *lo) {
+        *lo = zlo;
+        *hi = zhi;
+    }
+}
+
+/*
+ * zero_of - Widen [*lo, *hi) with the known zero range of free block ptr
+ */
+static void zero_of(char *ptr, char **lo, char **hi)
+{
+    if (GET_SIZE(HDRP(ptr)) >= PURGE_MIN)
+        zero_merge(lo, hi, ZERO_LO(ptr), ZERO_HI(ptr));
+}
+
+/*
+ * zero_add - Widen the known zero range of large free block ptr with the
+ *            bytes of [lo, hi) between its purge fields and its footer
+ *            (the only payload bytes free block bookkeeping writes)
+ */
+static void zero_add(char *ptr, char *lo, char *hi)
+{
+    if (GET_SIZE(HDRP(ptr)) < PURGE_MIN)
+        return;
+    lo = MAX(lo, ptr + PURGE_HDR);
+    hi = MIN(hi, FTR_HI(FTRP(ptr)));
+    zero_merge(&ZERO_LO(ptr), &ZERO_HI(ptr), lo, hi);
+}
+
+/*
  * find_fit - Find a fit for a block with asize bytes
- *            Iterate over free list until we get 
- *            free block >= requested asize
+ *            Start at the class of asize. An exact class holds only
+ *            blocks of size asize, so its head fits. Otherwise iterate
+ *            over the class list until we get free block >= asize.
+ *            Next fit starts at the rover if it is in that class, and
+ *            wraps around. Every block in a later class is bigger, so
+ *            take its head. Address ordered classes take the lowest
+ *            block that fits instead (tree_first).
+ *            Large requests (and small ones no list can serve) take
+ *            the best fit from the tree.
  */
-static void *find_fit (size_t asize)
+static void *find_fit(arena_t *a, size_t asize)
 {
-    /* First-fit search */
-    void *ptr;
+#ifdef REALTIME
+    /*
+     * Good-fit search: round asize up to the start of the next class
+     * so every block of the class found is big enough. Then take the
+     * first non empty class at or above it from the bitmaps.
+     */
+    unsigned int fl, sl, sl_map, fl_map;
+    int idx;
+
+    if (asize >= (1 << FL_SHIFT))
+        asize += (1UL << (FLS(asize) - SL_SHIFT)) - 1;
+    idx = sizeclass(asize);
+    fl = idx / SL_COUNT;
+    sl = idx % SL_COUNT;
+
+    sl_map = a->sl_bitmap[fl] & (~0U << sl);
+    if (sl_map == 0) {
+        /* Nothing left at this first level, go to a bigger one */
+        fl_map = a->fl_bitmap & (~0U << (fl + 1));
+        if (fl_map == 0)
+            return NULL; /* No fit */
+        fl = __builtin_ctz(fl_map);
+        sl_map = a->sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
 
-    /* Iterate over free list till we find the first block that fits */
-    for (ptr = free_listp; ptr != NULL; ptr = NEXT_FREEP(ptr)) {
-        if (!GET_ALLOC(HDRP(ptr)) && (asize <= GET_SIZE(HDRP(ptr)))) {
-            return ptr;
+    return SEG_LIST(a, fl * SL_COUNT + sl);
+#else
+    char *ptr, *start;
+    int idx;
+
+    if (asize >= TREE_MIN)
+        return tree_fit(a, asize);
+
+    /* Address ordered: lowest block that fits in the class, else the
+     * lowest of the next non empty class */
+    idx = sizeclass(asize);
+    if (a->policy == MM_PLACE_ADDRESS) {
+        ptr = tree_first(SEG_LIST(a, idx), asize);
+        for (idx++; ptr == NULL && idx < NUM_CLASSES; idx++)
+            ptr = tree_first(SEG_LIST(a, idx), 0);
+        return (ptr != NULL) ? ptr : tree_fit(a, asize);
+    }
+
+    /* First-fit search inside the class of the request (from the rover,
+     * if any in this class) */
+    start = SEG_LIST(a, idx);
+    if (a->rover != NULL && sizeclass(GET_SIZE(HDRP(a->rover))) == idx)
+        start = a->rover;
+    for (ptr = start; ptr != NULL; ptr = NEXT_FREEP(ptr)) {
+        if (asize <= GET_SIZE(HDRP(ptr)))
+            break;
+    }
+    if (ptr == NULL && start != SEG_LIST(a, idx)) {
+        for (ptr = SEG_LIST(a, idx); ptr != start; ptr = NEXT_FREEP(ptr)) {
+            if (asize <= GET_SIZE(HDRP(ptr)))
+                break;
         }
+        if (ptr == start)
+            ptr = NULL;
     }
-    return NULL; /* No fit */
+
+    /* Any block of a bigger class fits */
+    for (idx++; ptr == NULL && idx < NUM_CLASSES; idx++)
+        ptr = SEG_LIST(a, idx);
+
+    /* Large blocks: best fit from the tree */
+    if (ptr == NULL)
+        return tree_fit(a, asize);
+
+    /* Next search starts after it (place unlinks it) */
+    if (a->policy == MM_PLACE_NEXT_FIT)
+        a->rover = ptr;
+    return ptr;
+#endif
 }
 
 
-/* 
- * Print block - print block header and footer. 
+/*
+ * Print block - print block header and footer.
  * For debugging purposes
  */
 static void printblock(void *ptr)  {
     size_t hsize, fsize;
     size_t halloc, falloc;
-    hsize = GET_SIZE(HDRP(ptr));
-    fsize = GET_SIZE(FTRP(ptr));
-    halloc = GET_ALLOC(HDRP(ptr));
-    falloc = GET_ALLOC(FTRP(ptr));
 
     if (ptr == NULL ) {
         printf("Error: Null Pointer Address!! \n");
         return;
     }
-    printf("Addr: %p, Hdr: [%zu:%c], Ftr: [%zu:%c] \n",
-            ptr, hsize, (halloc ? 'a':'f'), fsize, (falloc ? 'a':'f'));
+
+    hsize = GET_SIZE(HDRP(ptr));
+    halloc = GET_ALLOC(HDRP(ptr));
+    if (halloc && OVERHEAD == WSIZE) {
+        printf("Addr: %p, Hdr: [%zu:%c%s] \n", ptr, hsize, 'a',
+                GET_PREV_ALLOC(HDRP(ptr)) ? "" : " prev free");
+        return;
+    }
+    fsize = FTR_SIZE(FTRP(ptr));
+    falloc = GET_ALLOC(FTRP(ptr));
+
+    printf("Addr: %p, Hdr: [%zu:%c%s], Ftr: [%zu:%c] \n",
+            ptr, hsize, (halloc ? 'a':'f'),
+            GET_PREV_ALLOC(HDRP(ptr)) ? "" : " prev free",
+            fsize, (falloc ? 'a':'f'));
     if (hsize == 0 && halloc == 1)
-        printf("Addr: %p - EOF Block \n", ptr); 
+        printf("Addr: %p - EOF Block \n", ptr);
 }
 
 
-/* 
- * checkblock - check block header and footer. 
+/*
+ * checkblock - check block header and footer.
  *
- * It is called by the Check Heap Function. 
- * Performs all checks done on each block. 
+ * It is called by the Check Heap Function.
+ * Performs all checks done on each block.
  *
- * These are 
+ * These are
  * - Minimum size
  * - Bounds checking
  * - Address alignment
- * Header and footer match
+ * Header and footer match (free blocks, or all with ALLOC_FOOTERS)
  */
 static void checkblock(void *ptr)  {
     /* Check each block's address alignment */
@@ -517,17 +2324,15 @@ static void checkblock(void *ptr)  {
         printf("Addr: %p - ** Block Alignment Error** \n", ptr);
         assert(0);
     }
-    /* Each block's bounds check */ 
+    /* Each block's bounds check */
     if (!in_heap(ptr)) {
         printf("Addr: %p - ** Out of Heap Bounds Error** \n", ptr);
         assert(0);
     }
     /* Check Minimum size */
-    if (GET_ALLOC(HDRP(ptr))) {
-        if (GET_SIZE(HDRP(ptr)) < (2*DSIZE)) {
-            printf("Addr: %p - ** Min Size Error ** \n", ptr);
-            assert(0);
-        }
+    if (GET_SIZE(HDRP(ptr)) < MINIMUM) {
+        printf("Addr: %p - ** Min Size Error ** \n", ptr);
+        assert(0);
     }
     /* Header/Footer Alignmment */
     if (GET_SIZE(HDRP(ptr)) % ALIGNMENT)  {
@@ -536,7 +2341,9 @@ static void checkblock(void *ptr)  {
     }
 
     /* Check header: footer match */
-    if ((GET_SIZE(HDRP(ptr)) != GET_SIZE(FTRP(ptr))) ||
+    if (GET_ALLOC(HDRP(ptr)) && OVERHEAD == WSIZE)
+        return;
+    if ((GET_SIZE(HDRP(ptr)) != FTR_SIZE(FTRP(ptr))) ||
             (GET_ALLOC(HDRP(ptr)) != GET_ALLOC(FTRP(ptr)))) {
         printf("Addr: %p - ** Header Footer mismatch** \n", ptr);
         printblock(ptr);
@@ -546,73 +2353,366 @@ static void checkblock(void *ptr)  {
 }
 
 
-/* 
- * insertfreeblock - Append free block to the front of list
- *                   Link new block to current free list and
- *                   set new block as top of current list. 
+/*
+ * sizeclass - Returns index of the class list for blocks of asize bytes.
+ *             Exact classes for small blocks, then one class per
+ *             power of two: (2^k, 2^(k+1)].
+ *             In REALTIME mode index is fl * SL_COUNT + sl, where fl is
+ *             the power of two of asize and sl the next SL_SHIFT bits.
+ */
+static int sizeclass(size_t asize) {
+    int idx;
+
+#ifdef REALTIME
+    int fl, sl;
+
+    if (asize < (1 << FL_SHIFT)) {
+        fl = 0;
+        sl = asize / ALIGNMENT;
+    } else {
+        fl = FLS(asize) - FL_SHIFT + 1;
+        sl = (asize >> (FLS(asize) - SL_SHIFT)) - SL_COUNT;
+    }
+    idx = fl * SL_COUNT + sl;
+#else
+    if (asize <= SMALL_MAX)
+        return (asize - MINIMUM) / ALIGNMENT;
+
+    /* Position of highest bit of (asize-1) picks the power of two class */
+    idx = NUM_SMALL + FLS(asize - 1) - SMALL_SHIFT;
+#endif
+    return (idx < NUM_CLASSES) ? idx : NUM_CLASSES - 1;
+}
+
+
+/*
+ * insertfreeblock - Append free block to the front of its class list
+ *                   Link new block to current class list and
+ *                   set new block as top of that list.
+ *                   Address ordered classes are trees: it goes in by
+ *                   address instead.
+ *                   Large blocks (their PURGED set) also go at the back
+ *                   of the dirty list.
  */
-static void insertfreeblock(void *ptr) {
-    /* If our free list has nothing, set it.  */ 
-    if (free_listp == NULL) {
-        NEXT_FREEP(ptr) = NULL;
-        PREV_FREEP(ptr) = NULL;
-        free_listp = ptr;
+static void insertfreeblock(arena_t *a, void *ptr) {
+    int idx;
+    char *head;
+
+    if (GET_SIZE(HDRP(ptr)) >= PURGE_MIN) {
+        PURGE_STATE(ptr) = PURGE_DIRTY;
+        PURGE_STAMP(ptr) = a->tick;
+        a->purged += PURGED(ptr);
+        dirty_link(a, ptr);
+    }
+
+#ifndef REALTIME
+    if (GET_SIZE(HDRP(ptr)) >= TREE_MIN) {
+        tree_insert(&a->tree_root, ptr);
         return;
     }
+#endif
+
+    idx = sizeclass(GET_SIZE(HDRP(ptr)));
+#ifndef REALTIME
+    if (a->policy == MM_PLACE_ADDRESS) {
+        tree_insert(&SEG_LIST(a, idx), ptr);
+        return;
+    }
+#endif
+    head = SEG_LIST(a, idx);
 
     PREV_FREEP(ptr) = NULL;
-    NEXT_FREEP(ptr) = free_listp;       /* Set curr next to head of list */
-    PREV_FREEP(free_listp) = ptr;                
+    NEXT_FREEP(ptr) = head;         /* Set curr next to head of list */
+    if (head != NULL)
+        PREV_FREEP(head) = ptr;
 
-    free_listp = ptr;                   /* curr ptr is now head of list */
+    SEG_LIST(a, idx) = ptr;            /* curr ptr is now head of list */
+
+#ifdef REALTIME
+    /* Flag the list (and its first level) as non empty */
+    a->sl_bitmap[idx / SL_COUNT] |= 1U << (idx % SL_COUNT);
+    a->fl_bitmap |= 1U << (idx / SL_COUNT);
+#endif
 }
 
 
-/* 
- * removefreeblock - Remove freed block from the list. 
- *      Coded to reflect all possible cases to avoid ambiguity
- *      CASE 1: Remove block with only one block in the list
- *      CASE 2: Block is top of list: Set next block as new top. 
- *      CASE 3: Block is end of free list: Set prev block as new end
- *      CASE 4: Freed block is a middle one: Link Prev block to next block
+/*
+ * removefreeblock - Remove freed block from its class list.
+ *      Block must still carry its free header, as the size picks the list.
+ *      CASE 1: Block is top of list: Set next block as new top.
+ *      CASE 2: Block is a middle/end one: Link Prev block to next block
+ *      In both cases next block (if any) points back to prev block.
  *
  */
-static void removefreeblock(void *ptr) {
-    /* Case when we have nothing in list */
-    if (free_listp == 0)
+static void removefreeblock(arena_t *a, void *ptr) {
+    char *prev, *next;
+
+    if (GET_SIZE(HDRP(ptr)) >= PURGE_MIN) {
+        if (PURGE_STATE(ptr) != PURGE_CLEAN)
+            dirty_unlink(a, ptr);
+        a->purged -= PURGED(ptr);
+    }
+
+#ifndef REALTIME
+    if (GET_SIZE(HDRP(ptr)) >= TREE_MIN) {
+        tree_remove(&a->tree_root, ptr);
         return;
+    }
+    if (a->policy == MM_PLACE_ADDRESS) {
+        tree_remove(&SEG_LIST(a, sizeclass(GET_SIZE(HDRP(ptr)))), ptr);
+        return;
+    }
+#endif
 
+    prev = PREV_FREEP(ptr);
+    next = NEXT_FREEP(ptr);
+    if (a->rover == ptr)
+        a->rover = next;
 
     /* Case 1 */
-    if ((PREV_FREEP(ptr) == NULL) && (NEXT_FREEP(ptr) == NULL)) {
-        free_listp = 0;
+    if (prev == NULL) {
+        int idx = sizeclass(GET_SIZE(HDRP(ptr)));
+        SEG_LIST(a, idx) = next;
+#ifdef REALTIME
+        /* List now empty: clear its bit, and its first level if last */
+        if (next == NULL) {
+            a->sl_bitmap[idx / SL_COUNT] &= ~(1U << (idx % SL_COUNT));
+            if (a->sl_bitmap[idx / SL_COUNT] == 0)
+                a->fl_bitmap &= ~(1U << (idx / SL_COUNT));
+        }
+#endif
     }
 
     /* Case 2 */
-    else if ((PREV_FREEP(ptr) == NULL) && (NEXT_FREEP(ptr) != NULL)) {
-        free_listp = NEXT_FREEP(ptr);
-        PREV_FREEP(free_listp) = NULL;  
+    else
+        NEXT_FREEP(prev) = next;
+
+    if (next != NULL)
+        PREV_FREEP(next) = prev;
+}
+
+
+/*
+ * setfreeblock - Write header and footer of free block ptr of size bytes.
+ *                Big blocks also get the high words of their size.
+ */
+static void setfreeblock(void *ptr, size_t size, size_t prev_alloc) {
+    size_t big = (size >= BIG_MIN) ? BIG : 0;
+
+    PUT(HDRP(ptr), PACK((unsigned int)size, big | prev_alloc));
+    if (big)
+        PUT(HDR_HI(HDRP(ptr)), size >> 32);
+    PUT(FTRP(ptr), PACK((unsigned int)size, big));
+    if (big)
+        PUT(FTR_HI(FTRP(ptr)), size >> 32);
+}
+
+
+#ifndef REALTIME
+/*
+ * rotateleft/rotateright - Tree rotations at *link. The child takes the
+ *                          place of the node, which becomes its child.
+ */
+static void rotateleft(char **link) {
+    char *ptr = *link;
+    char *child = RIGHT(ptr);
+
+    RIGHT(ptr) = LEFT(child);
+    LEFT(child) = ptr;
+    *link = child;
+}
+
+static void rotateright(char **link) {
+    char *ptr = *link;
+    char *child = LEFT(ptr);
+
+    LEFT(ptr) = RIGHT(child);
+    RIGHT(child) = ptr;
+    *link = child;
+}
+
+
+/*
+ * tree_insert - Insert large free block in the subtree at *link.
+ *               Goes down by (size, address) like a plain BST, then
+ *               rotates the new leaf up while its priority is higher.
+ */
+static void tree_insert(char **link, char *ptr) {
+    char *node = *link;
+
+    if (node == NULL) {
+        LEFT(ptr) = NULL;
+        RIGHT(ptr) = NULL;
+        *link = ptr;
+        return;
     }
 
-    /* Case 3 */
-    else if ((PREV_FREEP(ptr) != NULL) && (NEXT_FREEP(ptr) == NULL)) {
-        /* Last one now points to NULL */
-        NEXT_FREEP(PREV_FREEP(ptr)) = NULL; 
+    if (TREE_LESS(ptr, node)) {
+        tree_insert(&LEFT(node), ptr);
+        if (PRIORITY(LEFT(node)) > PRIORITY(node))
+            rotateright(link);
+    }
+    else {
+        tree_insert(&RIGHT(node), ptr);
+        if (PRIORITY(RIGHT(node)) > PRIORITY(node))
+            rotateleft(link);
     }
+}
 
-    /* Case 4 */
-    else if ((PREV_FREEP(ptr) != NULL) && (NEXT_FREEP(ptr) != NULL)) {
-        PREV_FREEP(NEXT_FREEP(ptr)) = PREV_FREEP(ptr);  
-        NEXT_FREEP(PREV_FREEP(ptr)) = NEXT_FREEP(ptr); 
+
+/*
+ * tree_remove - Remove free block from the tree at *root.
+ *      Block must still carry its free header, as the size is the key.
+ *      Find the link pointing at the block, then rotate the block down
+ *      (child with higher priority goes up) until it is a leaf, and cut.
+ */
+static void tree_remove(char **root, char *ptr) {
+    char **link = root;
+
+    while (*link != ptr)
+        link = TREE_LESS(ptr, *link) ? &LEFT(*link) : &RIGHT(*link);
+
+    while (LEFT(ptr) != NULL || RIGHT(ptr) != NULL) {
+        if (RIGHT(ptr) == NULL || (LEFT(ptr) != NULL &&
+                    PRIORITY(LEFT(ptr)) > PRIORITY(RIGHT(ptr)))) {
+            rotateright(link);
+            link = &RIGHT(*link);
+        }
+        else {
+            rotateleft(link);
+            link = &LEFT(*link);
+        }
     }
+    *link = NULL;
+}
+
+
+/*
+ * tree_fit - Best fit: smallest block of the tree with size >= asize.
+ *            Lowest address wins among blocks of the same size.
+ */
+static void *tree_fit(arena_t *a, size_t asize) {
+    char *node = a->tree_root;
+    char *fit = NULL;
+
+    while (node != NULL) {
+        if (GET_SIZE(HDRP(node)) >= asize) {
+            fit = node;             /* Fits, look for a smaller one */
+            node = LEFT(node);
+        }
+        else
+            node = RIGHT(node);
+    }
+    return fit;
+}
+
 
+/*
+ * tree_first - First fit in the address ordered tree at ptr: its lowest
+ *              block with size >= asize. The leftmost block when every
+ *              block fits (exact classes), else an in-order walk.
+ */
+static void *tree_first(char *ptr, size_t asize) {
+    char *fit;
+
+    if (ptr == NULL)
+        return NULL;
+    if ((fit = tree_first(LEFT(ptr), asize)) != NULL)
+        return fit;
+    if (GET_SIZE(HDRP(ptr)) >= asize)
+        return ptr;
+    return tree_first(RIGHT(ptr), asize);
 }
 
 
-/* 
- * freelistedge - Returns 1 is free list ptr is at edge of list. 
- *                This check is used to handle edge conditions in checkblock. 
+/*
+ * tree_check - Checks subtree at ptr, all of whose keys must lie
+ *              between lo and hi (NULL means unbounded).
+ *              Returns the number of blocks in the subtree.
+ *    Each node is in heap, free and large (or of class idx, in the
+ *    tree of an address ordered class; idx is -1 for the large tree)
+ *    BST order on (size, address), or address, and heap order on priority
+ */
+static int tree_check(char *ptr, int idx, char *lo, char *hi) {
+    if (ptr == NULL)
+        return 0;
+
+    if (!in_heap(ptr)) {
+        printf("Addr: %p - ** Tree Out of bounds** \n", ptr);
+        assert(0);
+    }
+    if (GET_ALLOC(HDRP(ptr)) || (idx < 0 ? GET_SIZE(HDRP(ptr)) < TREE_MIN :
+                sizeclass(GET_SIZE(HDRP(ptr))) != idx)) {
+        printf("Addr: %p - ** Tree Block Error** \n", ptr);
+        assert(0);
+    }
+    if ((lo != NULL && TREE_LESS(ptr, lo)) ||
+            (hi != NULL && TREE_LESS(hi, ptr))) {
+        printf("Addr: %p - ** Tree Order Error** \n", ptr);
+        assert(0);
+    }
+    if ((LEFT(ptr) != NULL && PRIORITY(LEFT(ptr)) > PRIORITY(ptr)) ||
+            (RIGHT(ptr) != NULL && PRIORITY(RIGHT(ptr)) > PRIORITY(ptr))) {
+        printf("Addr: %p - ** Tree Priority Error** \n", ptr);
+        assert(0);
+    }
+
+    return 1 + tree_check(LEFT(ptr), idx, lo, ptr) +
+        tree_check(RIGHT(ptr), idx, ptr, hi);
+}
+#endif
+
+/*
+ * slab_check - Walk every slab of arena a and check its slot count,
+ *              bitmap and list membership. Returns the number of slabs.
+ *              Arena lock must be held.
  */
-static int freelistedge(void *ptr) {
-    return ((NEXT_FREEP(ptr) == NULL) || (PREV_FREEP(ptr) == NULL));
+static int slab_check(arena_t *a) {
+    char *lo = mem_region_lo(SLAB_REGION(a));
+    char *hi = mem_region_hi(SLAB_REGION(a));
+    slab_t *s, *t;
+    int i, n, bits, numslabs = 0, numlisted = 0;
+
+    /* Slabs are listed (partial or empty) iff they have a free slot */
+    for (s = (slab_t *)lo; (char *)s < hi; s = (slab_t *)((char *)s + SLAB_SIZE)) {
+        if (s->size != 0 && (s->size % ALIGNMENT || s->size > SLAB_MAX ||
+                s->nslots != (SLAB_SIZE - SLAB_FIRST) / s->size)) {
+            printf("Slab: %p - ** Slab Size Error** \n", (void *)s);
+            assert(0);
+        }
+        for (bits = 0, i = 0; i < SLAB_WORDS; i++)
+            bits += __builtin_popcountl(s->map[i]);
+        n = (s->size == 0) ? 0 : (int)s->used + 64 * SLAB_WORDS - (int)s->nslots;
+        if (s->size != 0 && bits != n) {
+            printf("Slab: %p - ** Slab Bitmap Error** \n", (void *)s);
+            assert(0);
+        }
+        if (s->size == 0 || s->used < s->nslots)
+            numslabs++;
+    }
+
+    for (i = 0; i < SLAB_CLASSES; i++) {
+        for (s = a->slabs[i]; s != NULL; s = s->next) {
+            if (SLAB_OF(s) != s || !mem_in_heap(s, (char *)s + SLAB_SIZE - 1) ||
+                    (int)SLAB_IDX(s->size) != i || s->used >= s->nslots ||
+                    (s->next != NULL && s->next->prev != s)) {
+                printf("Slab: %p - ** Slab List Error** \n", (void *)s);
+                assert(0);
+            }
+            numlisted++;
+        }
+    }
+    for (t = a->slab_empty; t != NULL; t = t->next) {
+        if (t->size != 0) {
+            printf("Slab: %p - ** Empty Slab Error** \n", (void *)t);
+            assert(0);
+        }
+        numlisted++;
+    }
+
+    if (numslabs != numlisted) {
+        printf(" Error: - ** %d Slabs Listed %d ** \n", numslabs, numlisted);
+        assert(0);
+    }
+    return numslabs;
 }
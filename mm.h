@@ -7,6 +7,11 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void *mm_calloc (size_t nmemb, size_t size);
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+extern size_t mm_malloc_usable_size(void *ptr);
+extern void mm_free_sized(void *ptr, size_t size);
 
 #else
 
@@ -15,10 +20,38 @@ extern void *malloc (size_t size);
 extern void free (void *ptr);
 extern void *realloc(void *ptr, size_t size);
 extern void *calloc (size_t nmemb, size_t size);
+extern void *memalign(size_t alignment, size_t size);
+extern int posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *aligned_alloc(size_t alignment, size_t size);
+extern size_t malloc_usable_size(void *ptr);
+extern void free_sized(void *ptr, size_t size);
 
 #endif
 
 extern int mm_init(void);
 
+/* Tunables, set with mm_mallopt(param, value); returns 1 if done, else 0 */
+#define MM_MMAP_THRESHOLD 1  /* Requests of value bytes and up are mmapped */
+#define MM_TRIM_THRESHOLD 2  /* Free top of heap over 2 * value is released */
+#define MM_PURGE_DECAY    3  /* Frees before large free blocks are purged */
+#define MM_QUICK_MAX      4  /* Freed blocks up to value bytes coalesce late */
+#define MM_PLACEMENT      5  /* Class list order, MM_PLACE_*, for new arenas */
+
+/* Placement policies (MM_PLACEMENT) */
+#define MM_PLACE_LIFO     0  /* Freed blocks first, first fit */
+#define MM_PLACE_ADDRESS  1  /* Lists by address, first fit */
+#define MM_PLACE_NEXT_FIT 2  /* Freed blocks first, search from the last fit */
+
+extern int mm_mallopt(int param, int value);
+
+/* Give the free top of each heap back, but pad bytes; 1 if any released */
+extern int mm_trim(size_t pad);
+
+/* Allocate n blocks of size bytes in out[]; returns how many were */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+
+/* Free the n blocks of ptrs[], which gets sorted by address */
+extern void mm_free_batch(void **ptrs, size_t n);
+
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
@@ -0,0 +1,123 @@
+/*
+ * rep2bin.c - Convert .rep trace files to the binary format of tracebin.h
+ *
+ * usage: rep2bin <file.rep>...
+ *
+ * Each foo.rep is written next to itself as foo.bin, which mdriver
+ * maps and decodes instead of scanning the text (./mdriver -b).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracebin.h"
+
+/* Print an error about trace file name, return -1 */
+static int fail(const char *name, const char *msg) {
+    fprintf(stderr, "rep2bin: %s: %s, skipped\n", name, msg);
+    return -1;
+}
+
+/*
+ * convert - Write the binary twin of one .rep file, return 0 or -1
+ */
+static int convert(const char *name) {
+    FILE *in, *out;
+    tracebin_hdr_t hdr;
+    int weight, num_ids, num_ops, ignore_ranges;
+    unsigned char *buf, *p;
+    char outname[1024];
+    char type[16];
+    long index;
+    size_t size = 0, align = 0, len;
+    int i;
+
+    if ((in = fopen(name, "r")) == NULL)
+        return fail(name, "cannot open");
+    if (fscanf(in, "%d %d %d %d", &weight, &num_ids, &num_ops,
+               &ignore_ranges) != 4 || num_ids < 0 || num_ops < 0) {
+        fclose(in);
+        return fail(name, "bad header");
+    }
+
+    if ((buf = malloc((size_t)num_ops * (1 + 3 * VARINT_MAX) + 1)) == NULL) {
+        fclose(in);
+        return fail(name, "out of memory");
+    }
+    p = buf;
+
+    for (i = 0; i < num_ops; i++) {
+        if (fscanf(in, "%15s %ld", type, &index) != 2)
+            break;
+        if (index < -1 || index >= num_ids || !strchr("acmrf", type[0]))
+            break;
+        *p++ = type[0];
+        p = varint_put(p, (uint64_t)(index + 1));
+
+        /* A missing number keeps the last one, as in mdriver's reader */
+        switch (type[0]) {
+        case 'a':
+        case 'c':
+        case 'r':
+            fscanf(in, "%zu", &size);
+            p = varint_put(p, size);
+            break;
+        case 'm':
+            fscanf(in, "%zu %zu", &align, &size);
+            p = varint_put(p, align);
+            p = varint_put(p, size);
+            break;
+        }
+    }
+    fclose(in);
+    if (i != num_ops) {
+        free(buf);
+        return fail(name, "bad op or index, or too few ops");
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACEBIN_MAGIC, TRACEBIN_MAGIC_LEN);
+    hdr.weight = weight;
+    hdr.num_ids = num_ids;
+    hdr.num_ops = num_ops;
+    hdr.ignore_ranges = ignore_ranges;
+    hdr.op_bytes = p - buf;
+
+    /* foo.rep becomes foo.bin, anything else gets .bin appended */
+    len = strlen(name);
+    if (len + 5 > sizeof(outname)) {
+        free(buf);
+        return fail(name, "name too long");
+    }
+    strcpy(outname, name);
+    if (len > 4 && strcmp(name + len - 4, ".rep") == 0)
+        outname[len - 4] = '\0';
+    strcat(outname, ".bin");
+
+    if ((out = fopen(outname, "wb")) == NULL) {
+        free(buf);
+        return fail(outname, "cannot create");
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+        fwrite(buf, 1, p - buf, out) != (size_t)(p - buf) ||
+        fclose(out) != 0) {
+        free(buf);
+        remove(outname);
+        return fail(outname, "write failed");
+    }
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int i, status = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.rep>...\n", argv[0]);
+        return 1;
+    }
+    for (i = 1; i < argc; i++)
+        if (convert(argv[i]) < 0)
+            status = 1;
+    return status;
+}
@@ -0,0 +1,52 @@
+/*
+ * tracebin.h - Binary trace format, written by rep2bin and mapped by mdriver
+ *
+ * A fixed header, then one packed record per op: the .rep type letter
+ * ('a', 'c', 'm', 'r' or 'f'), the block index plus one (so the NULL
+ * free, index -1, is 0), and for every op but a free the size. Memalign
+ * puts its alignment before the size. Numbers are LEB128 varints, the
+ * header fields are in host byte order.
+ */
+#include <stdint.h>
+
+#define TRACEBIN_MAGIC   "MMTRACE1"
+#define TRACEBIN_MAGIC_LEN 8
+
+typedef struct {
+    char magic[TRACEBIN_MAGIC_LEN];
+    uint32_t weight;
+    uint32_t num_ids;
+    uint32_t num_ops;
+    uint32_t ignore_ranges;
+    uint64_t op_bytes;          /* Length of the op records that follow */
+} tracebin_hdr_t;
+
+/* Longest varint of a 64 bit value */
+#define VARINT_MAX 10
+
+/* Append v to p, return the byte after it */
+static inline unsigned char *varint_put(unsigned char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+/* Read a varint at p into *v, return the byte after it or NULL past end */
+static inline const unsigned char *varint_get(const unsigned char *p,
+                                              const unsigned char *end,
+                                              uint64_t *v) {
+    uint64_t x = 0;
+    int shift;
+
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        x |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80)) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}